@@ -0,0 +1,113 @@
+#include "game.h"
+#include <string.h>
+
+// After game.h, which includes nob.h for its declarations only
+#define NOB_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+// Registry stress benchmark. For 10k, 100k and 1M entities: spawns them
+// all with spawn_entities(), runs update frames that move every entity
+// through the positions array, and iterates positions and editor state
+// the way picking does. Prints spawn rate, median per-frame costs and the
+// registry's bytes per entity. Headless; no models are loaded.
+//
+//   bench_entities [--frames N]
+
+static const size_t entityCounts[] = { 10 * 1000, 100 * 1000, 1000 * 1000 };
+
+static int compare_nanos(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t median_nanos(uint64_t *samples, int count)
+{
+    qsort(samples, count, sizeof(uint64_t), compare_nanos);
+    return samples[count / 2];
+}
+
+// One frame of movement: every entity drifts forward like the player does
+static void update_positions(Registry *reg, float timeDelta)
+{
+    for (size_t i = 0; i < reg->count; ++i) {
+        reg->positions[i].z += 10.0f * timeDelta;
+        reg->positions[i].y += 0.5f * timeDelta;
+    }
+}
+
+// Counts entities inside a box, reading positions and editor state only
+static size_t count_in_box(const Registry *reg, Vector3 min, Vector3 max)
+{
+    size_t inside = 0;
+    for (size_t i = 0; i < reg->count; ++i) {
+        Vector3 p = reg->positions[i];
+        bool hit = p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z;
+        inside += hit && !reg->editors[i].is_selected;
+    }
+    return inside;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 100;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--frames N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames < 1) frames = 1;
+
+    uint64_t *samples = (uint64_t *)malloc(frames * sizeof(uint64_t));
+    if (samples == NULL) return 1;
+
+    printf("%10s %12s %12s %10s %12s %10s %10s\n",
+           "entities", "spawn ms", "Mspawn/s", "update ms", "ns/entity", "iterate ms", "B/entity");
+
+    size_t checksum = 0;
+    for (size_t c = 0; c < sizeof(entityCounts) / sizeof(entityCounts[0]); c++) {
+        size_t count = entityCounts[c];
+        Game game = game_init();
+
+        EntityTemplate tmpl = {
+            .position = {512, 150, 512},
+            .rotation = {0, 0, 0},
+            .scale = {1, 1, 1},
+            .mesh = { .type = MESH_CUBE, .color = RED },
+        };
+        uint64_t start = nob_nanos_since_unspecified_epoch();
+        spawn_entities(&game, &tmpl, count, NULL);
+        double spawnMs = (nob_nanos_since_unspecified_epoch() - start) / 1e6;
+
+        // Spread them out so the box test has something to decide
+        for (size_t i = 0; i < count; ++i) game.reg.positions[i].x += (float)(i & 1023);
+
+        for (int f = 0; f < frames; f++) {
+            start = nob_nanos_since_unspecified_epoch();
+            update_positions(&game.reg, 1.0f / 60.0f);
+            samples[f] = nob_nanos_since_unspecified_epoch() - start;
+        }
+        double updateMs = median_nanos(samples, frames) / 1e6;
+
+        for (int f = 0; f < frames; f++) {
+            start = nob_nanos_since_unspecified_epoch();
+            checksum += count_in_box(&game.reg, (Vector3){512, 0, 0}, (Vector3){1024, 1000, 1000});
+            samples[f] = nob_nanos_since_unspecified_epoch() - start;
+        }
+        double iterateMs = median_nanos(samples, frames) / 1e6;
+
+        printf("%10zu %12.2f %12.1f %10.3f %12.2f %10.3f %10.1f\n",
+               count, spawnMs, count / spawnMs / 1e3, updateMs, updateMs * 1e6 / count, iterateMs,
+               (double)registry_memory_bytes(&game.reg) / count);
+        game_free(&game);
+    }
+
+    // Keeps the iteration from being optimized away
+    fprintf(stderr, "checksum %zu\n", checksum);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,468 @@
+#define NOB_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "voxel_space_map.h"
+#include "terrain.h"
+#include "voxel_kernels.h"
+#include "terrain_gen.h"
+#include <math.h>
+#include <string.h>
+
+// Microbenchmarks for the operations in the column marching inner loop,
+// then whole frames per kernel and framebuffer layout. Single threaded, so
+// the numbers show the per-core cost.
+//
+//   bench_kernels [--map INDEX] [--reps N] [--warmup N] [--only OP]
+//
+// Every variant of an operation is registered in 'benches' and runs over
+// the same inputs, so scalar, SIMD and fixed-point code can be compared
+// directly. Each runs a few untimed repetitions first, then the median of
+// the timed ones is reported per sample: nanoseconds, estimated core cycles
+// and millions of samples per second.
+//
+// The whole-frame table times every kernel writing rows directly against
+// writing columns contiguously and transposing them back to rows, which is
+// what set_render_column_major() does. Each kernel's image is also compared
+// with the scalar one, which the fixed-point kernel only has to match within
+// VOXEL_FIXED_TOLERANCE.
+//
+// The generate op fills whole pages of procedural terrain, so pages per
+// second are its Msamples/s divided by VOXEL_PAGE_TEXELS (about 0.066).
+
+#define SAMPLE_COUNT (64 * 1024)
+#define SPANS_PER_COLUMN 16
+#define PROJECT_DEPTH 200
+
+typedef struct
+{
+    const Terrain *terrain;
+    VoxelFrame rowFrame;
+    VoxelFrame columnFrame;
+    Color *rows;
+    Color *columns;
+
+    // Inputs and outputs of the per-sample operations, SAMPLE_COUNT each
+    float *x, *y;
+    uint32_t *fixedX, *fixedY;
+    float *heights;
+    int32_t *fixedHeights;
+    int *projected;
+    Color *pixels;
+    Color *fogged;
+
+    float *fogFactors; // VOXEL_MAX_DEPTH
+
+    Image colorImage;
+    Color *decodedColors;
+    Color *decodedHeights;
+    TerrainTexel *texels; // MAP_N * MAP_N
+
+    TerrainGenerator generator;
+    TerrainTexel *page; // VOXEL_PAGE_TEXELS
+} BenchData;
+
+typedef struct
+{
+    const char *op;
+    const char *variant;
+    VoxelKernel requires; // SCALAR for portable code
+    long long (*run)(BenchData *data); // returns the samples processed
+} MicroBench;
+
+static VoxelFogEntry fogTable[VOXEL_MAX_DEPTH];
+static int32_t invZTable[VOXEL_MAX_DEPTH];
+
+static long long bilinear(BenchData *data, VoxelKernel kernel)
+{
+    voxel_op_bilinear(kernel, data->terrain->texels, data->x, data->y, data->heights, SAMPLE_COUNT);
+    return SAMPLE_COUNT;
+}
+
+static long long bilinear_scalar(BenchData *data) { return bilinear(data, VOXEL_KERNEL_SCALAR); }
+static long long bilinear_sse2(BenchData *data) { return bilinear(data, VOXEL_KERNEL_SSE2); }
+static long long bilinear_avx2(BenchData *data) { return bilinear(data, VOXEL_KERNEL_AVX2); }
+static long long bilinear_neon(BenchData *data) { return bilinear(data, VOXEL_KERNEL_NEON); }
+
+static long long bilinear_fixed(BenchData *data)
+{
+    voxel_op_bilinear_fixed(data->terrain->texels, data->fixedX, data->fixedY, data->fixedHeights, SAMPLE_COUNT);
+    return SAMPLE_COUNT;
+}
+
+static long long project(BenchData *data, VoxelKernel kernel)
+{
+    voxel_op_project(kernel, &data->rowFrame, data->heights, PROJECT_DEPTH, data->projected, SAMPLE_COUNT);
+    return SAMPLE_COUNT;
+}
+
+static long long project_scalar(BenchData *data) { return project(data, VOXEL_KERNEL_SCALAR); }
+static long long project_sse2(BenchData *data) { return project(data, VOXEL_KERNEL_SSE2); }
+static long long project_avx2(BenchData *data) { return project(data, VOXEL_KERNEL_AVX2); }
+static long long project_neon(BenchData *data) { return project(data, VOXEL_KERNEL_NEON); }
+
+static long long project_fixed(BenchData *data)
+{
+    voxel_op_project_fixed(&data->rowFrame, data->fixedHeights, PROJECT_DEPTH, data->projected, SAMPLE_COUNT);
+    return SAMPLE_COUNT;
+}
+
+// GetScaledPixel() per pixel, as the spans were fogged before the packed tables
+static long long fog_float(BenchData *data)
+{
+    Color fog = { 180, 180, 180, 255 };
+    for (int i = 0; i < SAMPLE_COUNT; i++) {
+        data->fogged[i] = GetScaledPixel(data->pixels[i], fog, data->fogFactors[(i >> 4) & (VOXEL_MAX_DEPTH - 1)]);
+    }
+    return SAMPLE_COUNT;
+}
+
+static long long fog_packed(BenchData *data)
+{
+    for (int i = 0; i < SAMPLE_COUNT; i += 16) {
+        voxel_op_fog(&data->rowFrame, data->pixels + i, (i >> 4) & (VOXEL_MAX_DEPTH - 1), data->fogged + i, 16);
+    }
+    return SAMPLE_COUNT;
+}
+
+// A whole frame of spans, SPANS_PER_COLUMN to each column
+static long long fill_frame(const VoxelFrame *frame)
+{
+    for (int column = 0; column < RENDER_WIDTH; column++) {
+        for (int span = 0; span < SPANS_PER_COLUMN; span++) {
+            Color color = { (unsigned char)column, (unsigned char)(span * 16), 90, 255 };
+            int startY = span * RENDER_HEIGHT / SPANS_PER_COLUMN;
+            int endY = (span + 1) * RENDER_HEIGHT / SPANS_PER_COLUMN;
+            voxel_op_fill(frame, column, startY, endY, color);
+        }
+    }
+    return RENDER_WIDTH * RENDER_HEIGHT;
+}
+
+static long long fill_rows(BenchData *data) { return fill_frame(&data->rowFrame); }
+static long long fill_columns(BenchData *data) { return fill_frame(&data->columnFrame); }
+
+static long long fill_columns_transposed(BenchData *data)
+{
+    long long pixels = fill_frame(&data->columnFrame);
+    voxel_transpose_columns(data->columns, data->rows, 0, RENDER_WIDTH);
+    return pixels;
+}
+
+static long long decode_raylib(BenchData *data)
+{
+    Color *colors = LoadImageColors(data->colorImage);
+    UnloadImageColors(colors);
+    return MAP_N * MAP_N;
+}
+
+static long long decode_interleave(BenchData *data)
+{
+    terrain_interleave(data->texels, data->decodedColors, data->decodedHeights, MAP_N * MAP_N);
+    return MAP_N * MAP_N;
+}
+
+static long long generate(BenchData *data, VoxelKernel kernel)
+{
+    terrain_gen_page(&data->generator, kernel, 37, 101, data->page);
+    return VOXEL_PAGE_TEXELS;
+}
+
+static long long generate_scalar(BenchData *data) { return generate(data, VOXEL_KERNEL_SCALAR); }
+static long long generate_sse2(BenchData *data) { return generate(data, VOXEL_KERNEL_SSE2); }
+static long long generate_avx2(BenchData *data) { return generate(data, VOXEL_KERNEL_AVX2); }
+static long long generate_neon(BenchData *data) { return generate(data, VOXEL_KERNEL_NEON); }
+
+// Unsupported variants are skipped at run time
+static const MicroBench benches[] = {
+    { "bilinear", "scalar",     VOXEL_KERNEL_SCALAR, bilinear_scalar },
+    { "bilinear", "sse2",       VOXEL_KERNEL_SSE2,   bilinear_sse2 },
+    { "bilinear", "avx2",       VOXEL_KERNEL_AVX2,   bilinear_avx2 },
+    { "bilinear", "neon",       VOXEL_KERNEL_NEON,   bilinear_neon },
+    { "bilinear", "fixed",      VOXEL_KERNEL_SCALAR, bilinear_fixed },
+    { "project",  "scalar",     VOXEL_KERNEL_SCALAR, project_scalar },
+    { "project",  "sse2",       VOXEL_KERNEL_SSE2,   project_sse2 },
+    { "project",  "avx2",       VOXEL_KERNEL_AVX2,   project_avx2 },
+    { "project",  "neon",       VOXEL_KERNEL_NEON,   project_neon },
+    { "project",  "fixed",      VOXEL_KERNEL_SCALAR, project_fixed },
+    { "fog",      "float",      VOXEL_KERNEL_SCALAR, fog_float },
+    { "fog",      "packed",     VOXEL_KERNEL_SCALAR, fog_packed },
+    { "fill",     "rows",       VOXEL_KERNEL_SCALAR, fill_rows },
+    { "fill",     "columns",    VOXEL_KERNEL_SCALAR, fill_columns },
+    { "fill",     "columns+T",  VOXEL_KERNEL_SCALAR, fill_columns_transposed },
+    { "decode",   "raylib",     VOXEL_KERNEL_SCALAR, decode_raylib },
+    { "decode",   "interleave", VOXEL_KERNEL_SCALAR, decode_interleave },
+    { "generate", "scalar",     VOXEL_KERNEL_SCALAR, generate_scalar },
+    { "generate", "sse2",       VOXEL_KERNEL_SSE2,   generate_sse2 },
+    { "generate", "avx2",       VOXEL_KERNEL_AVX2,   generate_avx2 },
+    { "generate", "neon",       VOXEL_KERNEL_NEON,   generate_neon },
+};
+
+#define BENCH_COUNT ((int)(sizeof(benches) / sizeof(benches[0])))
+
+static int compare_nanos(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t median_nanos(uint64_t *samples, int count)
+{
+    qsort(samples, count, sizeof(uint64_t), compare_nanos);
+    return samples[count / 2];
+}
+
+// Core clock in cycles per nanosecond, from a chain of dependent adds that
+// retire one per cycle. An estimate, but it needs no access to the cycle
+// counters, which user code cannot read on every platform.
+static double estimate_cycles_per_ns(void)
+{
+    enum { ITERATIONS = 10 * 1000 * 1000, ADDS = 8 };
+    double best = 0.0;
+
+    for (int attempt = 0; attempt < 5; attempt++) {
+        uint64_t value = 0;
+        uint64_t start = nanos_since_unspecified_epoch();
+        for (int i = 0; i < ITERATIONS; i++) {
+            for (int k = 0; k < ADDS; k++) {
+                value += 1;
+                __asm__ volatile("" : "+r"(value));
+            }
+        }
+        uint64_t elapsed = nanos_since_unspecified_epoch() - start;
+        double rate = (double)ITERATIONS * ADDS / (double)elapsed;
+        if (rate > best) best = rate;
+    }
+    return best;
+}
+
+static void run_micro_benches(BenchData *data, int warmup, int reps, const char *only)
+{
+    uint64_t *samples = (uint64_t *)malloc(reps * sizeof(uint64_t));
+    if (samples == NULL) return;
+
+    double cyclesPerNs = estimate_cycles_per_ns();
+    printf("estimated clock %.2f GHz, median of %d repetitions after %d warmup\n", cyclesPerNs, reps, warmup);
+    printf("%-9s %-11s %10s %10s %10s %12s\n", "op", "variant", "samples", "ns/sample", "cyc/sample", "Msamples/s");
+
+    for (int b = 0; b < BENCH_COUNT; b++) {
+        const MicroBench *bench = &benches[b];
+        if (only && strcmp(only, bench->op) != 0) continue;
+        if (!voxel_kernel_supported(bench->requires)) continue;
+
+        long long count = 0;
+        for (int i = 0; i < warmup; i++) bench->run(data);
+        for (int i = 0; i < reps; i++) {
+            uint64_t start = nanos_since_unspecified_epoch();
+            count = bench->run(data);
+            samples[i] = nanos_since_unspecified_epoch() - start;
+        }
+
+        double nsPerSample = (double)median_nanos(samples, reps) / (double)count;
+        printf("%-9s %-11s %10lld %10.3f %10.2f %12.1f\n", bench->op, bench->variant, count,
+               nsPerSample, nsPerSample * cyclesPerNs, 1e3 / nsPerSample);
+    }
+
+    free(samples);
+}
+
+#define WARMUP_FRAMES 10
+#define TIMED_FRAMES 200
+
+static VoxelFrame make_frame(const Terrain *terrain, Color *target, bool columnMajor)
+{
+    // A fixed view over the middle of the map, looking along +x
+    float zfar = 600.0f;
+    float camAngle = 0.0f;
+    float sinangle = sinf(camAngle);
+    float cosangle = cosf(camAngle);
+
+    VoxelFrame frame = {
+        .texels = terrain->texels,
+        .fogTable = fogTable,
+        .invZTable = invZTable,
+        .target = target,
+        .columnMajor = columnMajor,
+        .sky = (Color){ 0, 0, 0, 0 },
+        .startRX = 512.0f,
+        .startRY = 512.0f,
+        .camHeight = 200.0f,
+        .initialStep = 1.0f,
+        .plx = cosangle * zfar + sinangle * zfar,
+        .ply = sinangle * zfar - cosangle * zfar,
+        .prx = cosangle * zfar - sinangle * zfar,
+        .pry = sinangle * zfar + cosangle * zfar,
+        .invZfar = 1.0f / zfar,
+        .invRenderWidth = 1.0f / (float)RENDER_WIDTH,
+        .zfarInt = (int)zfar,
+        .horizon = 100.0f,
+    };
+    return frame;
+}
+
+// Pixels per thousand that differ from the reference by more than
+// VOXEL_FIXED_TOLERANCE in some channel
+static double permille_over_tolerance(const Color *image, const Color *reference)
+{
+    int over = 0;
+    for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++) {
+        if (abs(image[i].r - reference[i].r) > VOXEL_FIXED_TOLERANCE ||
+            abs(image[i].g - reference[i].g) > VOXEL_FIXED_TOLERANCE ||
+            abs(image[i].b - reference[i].b) > VOXEL_FIXED_TOLERANCE ||
+            abs(image[i].a - reference[i].a) > VOXEL_FIXED_TOLERANCE) over++;
+    }
+    return over * 1000.0 / (RENDER_WIDTH * RENDER_HEIGHT);
+}
+
+// Renders the frame TIMED_FRAMES times, transposing into rows when given,
+// and returns the median frame time in milliseconds
+static double time_frames(VoxelKernelFn kernel, const VoxelFrame *frame, Color *rows)
+{
+    static uint64_t samples[TIMED_FRAMES];
+
+    for (int i = 0; i < WARMUP_FRAMES + TIMED_FRAMES; i++) {
+        uint64_t start = nanos_since_unspecified_epoch();
+        if (kernel) kernel(frame, 0, RENDER_WIDTH);
+        if (rows) voxel_transpose_columns(frame->target, rows, 0, RENDER_WIDTH);
+        uint64_t elapsed = nanos_since_unspecified_epoch() - start;
+        if (i >= WARMUP_FRAMES) samples[i - WARMUP_FRAMES] = elapsed;
+    }
+
+    return median_nanos(samples, TIMED_FRAMES) / 1e6;
+}
+
+static void run_frame_benches(BenchData *data, Color *reference)
+{
+    VoxelFrame referenceFrame = data->rowFrame;
+    referenceFrame.target = reference;
+    voxel_kernel_function(VOXEL_KERNEL_SCALAR)(&referenceFrame, 0, RENDER_WIDTH);
+
+    printf("\n%dx%d frames, median of %d (ms), pixels over tolerance vs scalar per 1000\n", RENDER_WIDTH, RENDER_HEIGHT, TIMED_FRAMES);
+    printf("%-8s %10s %10s %12s %10s\n", "kernel", "rows", "columns", "+transpose", "over tol");
+
+    for (int k = VOXEL_KERNEL_SCALAR; k < VOXEL_KERNEL_COUNT; k++) {
+        if (!voxel_kernel_supported((VoxelKernel)k)) continue;
+        VoxelKernelFn kernel = voxel_kernel_function((VoxelKernel)k);
+
+        double rowMs = time_frames(kernel, &data->rowFrame, NULL);
+        double columnMs = time_frames(kernel, &data->columnFrame, NULL);
+        double transposedMs = time_frames(kernel, &data->columnFrame, data->rows);
+        double diff = permille_over_tolerance(data->rows, reference);
+        printf("%-8s %10.3f %10.3f %12.3f %10.3f\n", voxel_kernel_name((VoxelKernel)k), rowMs, columnMs, transposedMs, diff);
+    }
+
+    printf("transpose alone: %.3f ms\n", time_frames(NULL, &data->columnFrame, data->rows));
+}
+
+static void *bench_alloc(size_t size)
+{
+    void *memory = malloc(size);
+    if (memory == NULL) {
+        fprintf(stderr, "bench_kernels: out of memory\n");
+        exit(1);
+    }
+    return memory;
+}
+
+// Points along short rays from scattered origins, so consecutive samples
+// hit neighbouring texels the way a marching column does
+static void fill_positions(BenchData *data)
+{
+    uint32_t seed = 12345;
+    for (int i = 0; i < SAMPLE_COUNT; i += 64) {
+        seed = seed * 1664525u + 1013904223u;
+        float originX = (float)(seed >> 22);
+        seed = seed * 1664525u + 1013904223u;
+        float originY = (float)(seed >> 22);
+        float angle = (float)(seed & 0xFFFF) / 65536.0f * 2.0f * PI;
+
+        for (int k = 0; k < 64; k++) {
+            float x = fmodf(originX + cosf(angle) * (k + 0.37f) + MAP_N, (float)MAP_N);
+            float y = fmodf(originY + sinf(angle) * (k + 0.37f) + MAP_N, (float)MAP_N);
+            data->x[i + k] = x;
+            data->y[i + k] = y;
+            data->fixedX[i + k] = (uint32_t)(x * 65536.0f);
+            data->fixedY[i + k] = (uint32_t)(y * 65536.0f);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int mapIndex = 0;
+    int warmup = 3;
+    int reps = 15;
+    const char *only = NULL;
+    bool validArgs = argc % 2 == 1;
+
+    for (int i = 1; validArgs && i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--map") == 0) mapIndex = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--reps") == 0) reps = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--warmup") == 0) warmup = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--only") == 0) only = argv[i + 1];
+        else validArgs = false;
+    }
+    if (!validArgs || mapIndex < 0 || mapIndex >= NUM_MAPS || reps < 1 || warmup < 0) {
+        fprintf(stderr, "usage: %s [--map 0-%d] [--reps N] [--warmup N] [--only bilinear|project|fog|fill|decode|generate]\n", argv[0], NUM_MAPS - 1);
+        return 1;
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+    LoadMaps();
+    Terrain terrain = { 0 };
+    if (!terrain_load(&terrain, maps[mapIndex].colorMap, maps[mapIndex].heightMap)) return 1;
+
+    BenchData data = { .terrain = &terrain };
+    data.rows = bench_alloc(RENDER_WIDTH * RENDER_HEIGHT * sizeof(Color));
+    data.columns = bench_alloc(RENDER_WIDTH * RENDER_HEIGHT * sizeof(Color));
+    data.x = bench_alloc(SAMPLE_COUNT * sizeof(float));
+    data.y = bench_alloc(SAMPLE_COUNT * sizeof(float));
+    data.fixedX = bench_alloc(SAMPLE_COUNT * sizeof(uint32_t));
+    data.fixedY = bench_alloc(SAMPLE_COUNT * sizeof(uint32_t));
+    data.heights = bench_alloc(SAMPLE_COUNT * sizeof(float));
+    data.fixedHeights = bench_alloc(SAMPLE_COUNT * sizeof(int32_t));
+    data.projected = bench_alloc(SAMPLE_COUNT * sizeof(int));
+    data.pixels = bench_alloc(SAMPLE_COUNT * sizeof(Color));
+    data.fogged = bench_alloc(SAMPLE_COUNT * sizeof(Color));
+    data.fogFactors = bench_alloc(VOXEL_MAX_DEPTH * sizeof(float));
+    data.texels = bench_alloc(MAP_N * MAP_N * sizeof(TerrainTexel));
+    data.page = bench_alloc(VOXEL_PAGE_TEXELS * sizeof(TerrainTexel));
+    terrain_gen_init(&data.generator, 1337, 8, 8, VOXEL_KERNEL_AUTO);
+
+    for (int z = 0; z < VOXEL_MAX_DEPTH; z++) data.fogFactors[z] = 1.0f / expf(z * 0.0025f);
+    voxel_fog_build(fogTable, data.fogFactors, VOXEL_MAX_DEPTH, (Color){ 180, 180, 180, 255 });
+    voxel_inv_z_build(invZTable, VOXEL_MAX_DEPTH, 0.0f);
+
+    fill_positions(&data);
+    for (int i = 0; i < SAMPLE_COUNT; i++) {
+        data.pixels[i] = terrain_texel_color(terrain.texels[(i * 37) & (MAP_N * MAP_N - 1)]);
+    }
+    // Heights for the projection benchmarks
+    voxel_op_bilinear(VOXEL_KERNEL_SCALAR, terrain.texels, data.x, data.y, data.heights, SAMPLE_COUNT);
+    voxel_op_bilinear_fixed(terrain.texels, data.fixedX, data.fixedY, data.fixedHeights, SAMPLE_COUNT);
+
+    data.colorImage = LoadImage(maps[mapIndex].colorMap);
+    Image heightImage = LoadImage(maps[mapIndex].heightMap);
+    data.decodedColors = LoadImageColors(data.colorImage);
+    data.decodedHeights = LoadImageColors(heightImage);
+    UnloadImage(heightImage);
+
+    data.rowFrame = make_frame(&terrain, data.rows, false);
+    data.columnFrame = make_frame(&terrain, data.columns, true);
+
+    printf("map %d\n", mapIndex);
+    run_micro_benches(&data, warmup, reps, only);
+
+    if (only == NULL) {
+        Color *reference = bench_alloc(RENDER_WIDTH * RENDER_HEIGHT * sizeof(Color));
+        run_frame_benches(&data, reference);
+        free(reference);
+    }
+
+    UnloadImageColors(data.decodedColors);
+    UnloadImageColors(data.decodedHeights);
+    UnloadImage(data.colorImage);
+    terrain_unload(&terrain);
+    return 0;
+}
@@ -0,0 +1,253 @@
+#define NOB_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "voxel_space_map.h"
+#include "voxel_renderer.h"
+#include "terrain.h"
+#include <math.h>
+#include <string.h>
+
+// Headless flythrough benchmark. Flies the same scripted camera path over
+// every map and prints per-map frame time percentiles, ray steps and
+// pixels written as JSON on stdout, so runs can be diffed across commits
+// and machines. Progress and errors go to stderr.
+//
+//   bench_voxel [--frames N] [--warmup N] [--threads N] [--kernel NAME]
+//               [--zfar D] [--lod START] [--skip-empty] [--column-major]
+//               [--palettized] [--map INDEX]
+
+typedef struct
+{
+    int frames;
+    int warmup;
+    int threads;
+    VoxelKernel kernel;
+    int map; // -1 for all of them
+    VoxelRenderConfig config;
+} BenchOptions;
+
+typedef struct
+{
+    double p50, p95, p99, mean; // milliseconds
+    double raySteps;            // mean per frame
+    double pixelsWritten;       // mean per frame
+} MapResult;
+
+static bool parse_kernel(const char *name, VoxelKernel *kernel)
+{
+    for (int k = 0; k < VOXEL_KERNEL_COUNT; k++) {
+        if (strcmp(name, voxel_kernel_name((VoxelKernel)k)) == 0) {
+            *kernel = (VoxelKernel)k;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions *options)
+{
+    *options = (BenchOptions){
+        .frames = 300,
+        .warmup = 30,
+        .threads = 0,
+        .kernel = VOXEL_KERNEL_AUTO,
+        .map = -1,
+        .config = voxel_render_config_default(),
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--skip-empty") == 0) {
+            options->config.skipEmpty = true;
+            continue;
+        }
+        if (strcmp(arg, "--column-major") == 0) {
+            options->config.columnMajor = true;
+            continue;
+        }
+        if (strcmp(arg, "--palettized") == 0) {
+            options->config.palettized = true;
+            continue;
+        }
+        if (value == NULL) {
+            fprintf(stderr, "bench_voxel: unknown option or missing value: %s\n", arg);
+            return false;
+        }
+
+        i++;
+        if (strcmp(arg, "--frames") == 0) options->frames = atoi(value);
+        else if (strcmp(arg, "--warmup") == 0) options->warmup = atoi(value);
+        else if (strcmp(arg, "--threads") == 0) options->threads = atoi(value);
+        else if (strcmp(arg, "--zfar") == 0) options->config.zfar = (float)atof(value);
+        else if (strcmp(arg, "--map") == 0) options->map = atoi(value);
+        else if (strcmp(arg, "--lod") == 0) {
+            options->config.lod = true;
+            options->config.lodStart = atoi(value);
+        } else if (strcmp(arg, "--kernel") == 0) {
+            if (!parse_kernel(value, &options->kernel)) {
+                fprintf(stderr, "bench_voxel: unknown kernel %s\n", value);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "bench_voxel: unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (options->frames < 1) options->frames = 1;
+    if (options->warmup < 0) options->warmup = 0;
+    if (options->map >= NUM_MAPS) {
+        fprintf(stderr, "bench_voxel: map must be in 0-%d\n", NUM_MAPS - 1);
+        return false;
+    }
+    return true;
+}
+
+// Camera for frame i of n: one lap of a wobbling loop around the map
+// centre, looking along the direction of travel, at a fixed clearance over
+// the terrain below. Only depends on i, n and the terrain, so every run
+// and every kernel sees the same frames.
+static Camera3D path_camera(const Terrain *terrain, int i, int n)
+{
+    float t = (float)i / (float)n * 2.0f * PI;
+    float radius = 300.0f + 80.0f * sinf(3.0f * t);
+
+    float x = MAP_N * 0.5f + radius * cosf(t);
+    float z = MAP_N * 0.5f + radius * sinf(t);
+    float dx = -sinf(t);
+    float dz = cosf(t);
+
+    int cell = ((int)z & (MAP_N - 1)) * MAP_N + ((int)x & (MAP_N - 1));
+    float ground = terrain->texels[cell].height;
+    float y = ground + 60.0f + 40.0f * sinf(5.0f * t);
+
+    return (Camera3D){
+        .position = (Vector3){ x, y, z },
+        .target = (Vector3){ x + dx * 30.0f, y - 15.0f, z + dz * 30.0f },
+        .up = (Vector3){ 0.0f, 1.0f, 0.0f },
+        .fovy = 45.0f,
+        .projection = CAMERA_PERSPECTIVE,
+    };
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int count, double p)
+{
+    int rank = (int)ceil(p / 100.0 * count);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+static void bench_map(VoxelRenderer *renderer, const BenchOptions *options, double *samples, MapResult *result)
+{
+    const Terrain *terrain = renderer->terrain;
+    double raySteps = 0.0;
+    double pixelsWritten = 0.0;
+    double total = 0.0;
+
+    for (int i = 0; i < options->warmup; i++) {
+        voxel_renderer_render(renderer, path_camera(terrain, i, options->warmup));
+    }
+
+    for (int i = 0; i < options->frames; i++) {
+        Camera3D camera = path_camera(terrain, i, options->frames);
+        uint64_t start = nanos_since_unspecified_epoch();
+        voxel_renderer_render(renderer, camera);
+        samples[i] = (nanos_since_unspecified_epoch() - start) / 1e6;
+
+        total += samples[i];
+        raySteps += renderer->lastRaySteps;
+        pixelsWritten += renderer->lastPixelsWritten;
+    }
+
+    qsort(samples, options->frames, sizeof(double), compare_doubles);
+    *result = (MapResult){
+        .p50 = percentile(samples, options->frames, 50.0),
+        .p95 = percentile(samples, options->frames, 95.0),
+        .p99 = percentile(samples, options->frames, 99.0),
+        .mean = total / options->frames,
+        .raySteps = raySteps / options->frames,
+        .pixelsWritten = pixelsWritten / options->frames,
+    };
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+    if (!parse_options(argc, argv, &options)) return 1;
+
+    SetTraceLogLevel(LOG_WARNING);
+    LoadMaps();
+
+    static Color pixels[RENDER_WIDTH * RENDER_HEIGHT];
+    static VoxelRenderer renderer;
+    Terrain terrain = { 0 };
+
+    if (!voxel_renderer_init(&renderer, &terrain, pixels, options.config)) return 1;
+    if (options.threads != 0) voxel_renderer_set_threads(&renderer, options.threads);
+    voxel_renderer_set_kernel(&renderer, options.kernel);
+
+    double *samples = (double *)malloc(options.frames * sizeof(double));
+    if (samples == NULL) {
+        fprintf(stderr, "bench_voxel: out of memory\n");
+        return 1;
+    }
+
+    printf("{\n");
+    printf("  \"width\": %d,\n", RENDER_WIDTH);
+    printf("  \"height\": %d,\n", RENDER_HEIGHT);
+    printf("  \"frames\": %d,\n", options.frames);
+    printf("  \"warmup\": %d,\n", options.warmup);
+    printf("  \"threads\": %d,\n", renderer.pool.threadCount);
+    printf("  \"cores\": %d,\n", worker_pool_core_count());
+    printf("  \"kernel\": \"%s\",\n", voxel_kernel_name(renderer.kernel));
+    printf("  \"zfar\": %g,\n", options.config.zfar);
+    printf("  \"lod\": %s,\n", options.config.lod ? "true" : "false");
+    printf("  \"lod_start\": %d,\n", options.config.lodStart);
+    printf("  \"skip_empty\": %s,\n", options.config.skipEmpty ? "true" : "false");
+    printf("  \"column_major\": %s,\n", options.config.columnMajor ? "true" : "false");
+    printf("  \"palettized\": %s,\n", options.config.palettized ? "true" : "false");
+    printf("  \"maps\": [");
+
+    int firstMap = options.map < 0 ? 0 : options.map;
+    int lastMap = options.map < 0 ? NUM_MAPS - 1 : options.map;
+    int failed = 0;
+    bool first = true;
+
+    for (int map = firstMap; map <= lastMap; map++) {
+        if (!terrain_load(&terrain, maps[map].colorMap, maps[map].heightMap)) {
+            fprintf(stderr, "bench_voxel: skipping map %d\n", map);
+            failed++;
+            continue;
+        }
+        if (options.config.palettized) terrain_build_indices(&terrain);
+
+        MapResult result;
+        bench_map(&renderer, &options, samples, &result);
+        fprintf(stderr, "map %2d: p50 %.3f ms, p99 %.3f ms\n", map, result.p50, result.p99);
+
+        printf("%s\n    {\"map\": %d, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"mean_ms\": %.4f, "
+               "\"ray_steps\": %.1f, \"pixels_written\": %.1f}",
+               first ? "" : ",", map, result.p50, result.p95, result.p99, result.mean,
+               result.raySteps, result.pixelsWritten);
+        first = false;
+    }
+
+    printf("\n  ]\n}\n");
+
+    free(samples);
+    voxel_renderer_free(&renderer);
+    terrain_unload(&terrain);
+    return failed > 0 ? 1 : 0;
+}
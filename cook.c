@@ -0,0 +1,119 @@
+#define NOB_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "voxel_space_map.h"
+#include "terrain.h"
+#include "worker_pool.h"
+#include <string.h>
+
+// Offline asset cooker. Cooks every map pair into TERRAIN_COOKED_FOLDER,
+// the format terrain_load_cached() memory-maps, with the maps split across
+// one thread per core. A cooked file whose recorded source hash still
+// matches its GIFs, with or without pyramids as asked, is up to date and
+// skipped.
+//
+//   cook [--force] [--threads N] [--no-pyramids]
+//
+// --no-pyramids leaves the mip chain and max-height pyramid out of the
+// files, making them about 30% smaller; they are then built at load time.
+// The palette and index planes are always written.
+//
+// The models under resources/models are left alone: they are binary glTF
+// already, which raylib's LoadModel() reads without a conversion step, and
+// raylib has no way to build meshes without a GL context to cook them into.
+
+typedef enum
+{
+    COOK_SKIPPED,
+    COOK_COOKED,
+    COOK_FAILED,
+} CookStatus;
+
+typedef struct
+{
+    bool force;
+    bool withPyramids;
+    CookStatus status[NUM_MAPS];
+    double milliseconds[NUM_MAPS];
+} CookJob;
+
+// Whether a mapped terrain's file carried the pyramids or they were built on load
+static bool cooked_with_pyramids(const Terrain *terrain)
+{
+    const uint8_t *begin = (const uint8_t *)terrain->mapping;
+    const uint8_t *maxHeights = terrain->maxHeights[0];
+    return maxHeights >= begin && maxHeights < begin + terrain->mappingSize;
+}
+
+static void cook_maps(void *userData, int begin, int end)
+{
+    CookJob *job = (CookJob *)userData;
+
+    for (int map = begin; map < end; map++) {
+        uint64_t start = nanos_since_unspecified_epoch();
+        char cookedPath[256];
+        terrain_cooked_path(maps[map].colorMap, cookedPath, sizeof(cookedPath));
+
+        uint64_t sourceHash = terrain_source_hash(maps[map].colorMap, maps[map].heightMap);
+        Terrain terrain = { 0 };
+
+        if (sourceHash == 0) {
+            job->status[map] = COOK_FAILED;
+        } else if (!job->force && terrain_load_cooked(&terrain, cookedPath, sourceHash) &&
+                   cooked_with_pyramids(&terrain) == job->withPyramids) {
+            job->status[map] = COOK_SKIPPED;
+        } else if (terrain_load(&terrain, maps[map].colorMap, maps[map].heightMap) &&
+                   terrain_cook(&terrain, sourceHash, job->withPyramids, cookedPath)) {
+            job->status[map] = COOK_COOKED;
+        } else {
+            job->status[map] = COOK_FAILED;
+        }
+
+        terrain_unload(&terrain);
+        job->milliseconds[map] = (nanos_since_unspecified_epoch() - start) / 1e6;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static CookJob job = { .withPyramids = true };
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--force") == 0) job.force = true;
+        else if (strcmp(argv[i], "--no-pyramids") == 0) job.withPyramids = false;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--force] [--threads N] [--no-pyramids]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+    LoadMaps();
+
+    WorkerPool pool;
+    if (!worker_pool_init(&pool, threads)) {
+        TraceLog(LOG_WARNING, "COOK: Falling back to a single thread");
+        if (!worker_pool_init(&pool, 1)) return 1;
+    }
+
+    uint64_t start = nanos_since_unspecified_epoch();
+    worker_pool_run(&pool, NUM_MAPS, 1, cook_maps, &job);
+    double totalMs = (nanos_since_unspecified_epoch() - start) / 1e6;
+
+    static const char *statusNames[] = { "up to date", "cooked", "FAILED" };
+    int counts[3] = { 0 };
+    for (int map = 0; map < NUM_MAPS; map++) {
+        char cookedPath[256];
+        terrain_cooked_path(maps[map].colorMap, cookedPath, sizeof(cookedPath));
+        printf("%-32s %-10s %8.1f ms\n", cookedPath, statusNames[job.status[map]], job.milliseconds[map]);
+        counts[job.status[map]]++;
+    }
+    printf("%d cooked, %d up to date, %d failed in %.1f ms on %d threads\n",
+           counts[COOK_COOKED], counts[COOK_SKIPPED], counts[COOK_FAILED], totalMs, pool.threadCount);
+
+    worker_pool_shutdown(&pool);
+    return counts[COOK_FAILED] > 0 ? 1 : 0;
+}
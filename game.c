@@ -7,130 +7,281 @@ Game game_init(void)
     return game;
 }
 
-Entity create_entity(Game *game) 
+// Smallest doubling of the current capacity, starting at 256, that holds needed
+static size_t grown_capacity(size_t capacity, size_t needed)
 {
-    Entity entity = {0};
+    size_t new_capacity = capacity == 0 ? 256 : capacity;
+    while (new_capacity < needed) new_capacity *= 2;
+    return new_capacity;
+}
 
-    entity.id = (uint32_t)(game->reg.count + 1);
-    
-    if (game->reg.count >= game->reg.capacity) 
-    {
-        size_t new_capacity = game->reg.capacity == 0 ? 256 : game->reg.capacity * 2;
-        game->reg.entities = NOB_REALLOC(game->reg.entities, new_capacity * sizeof(*game->reg.entities));
-        NOB_ASSERT(game->reg.entities);
-        game->reg.capacity = new_capacity;
+// Grows every component array together to hold at least capacity entities
+static void registry_reserve(Registry *reg, size_t capacity)
+{
+    if (capacity <= reg->capacity) return;
+    size_t new_capacity = grown_capacity(reg->capacity, capacity);
+
+    reg->handles = NOB_REALLOC(reg->handles, new_capacity * sizeof(*reg->handles));
+    reg->positions = NOB_REALLOC(reg->positions, new_capacity * sizeof(*reg->positions));
+    reg->rotations = NOB_REALLOC(reg->rotations, new_capacity * sizeof(*reg->rotations));
+    reg->scales = NOB_REALLOC(reg->scales, new_capacity * sizeof(*reg->scales));
+    reg->meshes = NOB_REALLOC(reg->meshes, new_capacity * sizeof(*reg->meshes));
+    reg->editors = NOB_REALLOC(reg->editors, new_capacity * sizeof(*reg->editors));
+    NOB_ASSERT(reg->handles && reg->positions && reg->rotations && reg->scales && reg->meshes && reg->editors);
+    reg->capacity = new_capacity;
+}
+
+// Grows the handle table to hold at least capacity handle indices
+static void registry_reserve_handles(Registry *reg, size_t capacity)
+{
+    if (capacity <= reg->handle_capacity) return;
+    size_t new_capacity = grown_capacity(reg->handle_capacity, capacity);
+
+    reg->generations = NOB_REALLOC(reg->generations, new_capacity * sizeof(*reg->generations));
+    reg->slots = NOB_REALLOC(reg->slots, new_capacity * sizeof(*reg->slots));
+    reg->free_list = NOB_REALLOC(reg->free_list, new_capacity * sizeof(*reg->free_list));
+    NOB_ASSERT(reg->generations && reg->slots && reg->free_list);
+    reg->handle_capacity = new_capacity;
+}
+
+// A handle for a new entity in the given slot, reusing a destroyed entity's
+// index when there is one. The handle table must have room.
+static Entity registry_new_handle(Registry *reg, size_t slot)
+{
+    uint32_t index;
+    if (reg->free_count > 0) {
+        index = reg->free_list[--reg->free_count];
+    } else {
+        index = (uint32_t)reg->handle_count++;
+        reg->generations[index] = 1;
     }
 
-    TransformComponent transform = {
-        .position = {0, 0, 0},
-        .rotation = {0, 0, 0},
-        .scale = {1, 1, 1}
-    };
+    reg->slots[index] = (uint32_t)slot;
+    return (Entity){ .index = index, .generation = reg->generations[index] };
+}
+
+void spawn_entities(Game *game, const EntityTemplate *tmpl, size_t count, Entity *handles)
+{
+    Registry *reg = &game->reg;
+    size_t reused = count < reg->free_count ? count : reg->free_count;
+    registry_reserve(reg, reg->count + count);
+    registry_reserve_handles(reg, reg->handle_count + count - reused);
 
-    MeshComponent mesh = {
-        .type = MESH_CUBE,
-        .color = RED
-    };
-    
     EditorComponent editor = {
         .is_selected = false,
         .is_hovered = false
     };
-    
-    entity.transform = transform;
-    entity.mesh = mesh;
-    entity.editor = editor;
-    game->reg.entities[game->reg.count] = entity;
-    game->reg.count++;
-    
+    for (size_t n = 0; n < count; ++n) {
+        size_t i = reg->count + n;
+        Entity entity = registry_new_handle(reg, i);
+        reg->handles[i] = entity;
+        reg->positions[i] = tmpl->position;
+        reg->rotations[i] = tmpl->rotation;
+        reg->scales[i] = tmpl->scale;
+        reg->meshes[i] = tmpl->mesh;
+        reg->editors[i] = editor;
+        if (handles) handles[n] = entity;
+    }
+    reg->count += count;
+
+    if (tmpl->mesh.type == MESH_MODEL) model_cache_retain(&game->models, tmpl->mesh.model, count);
+}
+
+// An entity at the origin with unit scale
+static Entity spawn_one(Game *game, MeshComponent mesh)
+{
+    EntityTemplate tmpl = {
+        .position = {0, 0, 0},
+        .rotation = {0, 0, 0},
+        .scale = {1, 1, 1},
+        .mesh = mesh
+    };
+    Entity entity;
+    spawn_entities(game, &tmpl, 1, &entity);
     return entity;
 }
 
-Entity create_entity_with_model(Game *game, const char* model_path) 
+size_t registry_memory_bytes(const Registry *reg)
 {
-    Entity entity = {0};
+    size_t per_entity = sizeof(*reg->handles) + sizeof(*reg->positions) + sizeof(*reg->rotations) +
+                        sizeof(*reg->scales) + sizeof(*reg->meshes) + sizeof(*reg->editors);
+    size_t per_handle = sizeof(*reg->generations) + sizeof(*reg->slots) + sizeof(*reg->free_list);
+    return reg->capacity * per_entity + reg->handle_capacity * per_handle;
+}
 
-    entity.id = (uint32_t)(game->reg.count + 1);
-    
-    if (game->reg.count >= game->reg.capacity) 
-    {
-        size_t new_capacity = game->reg.capacity == 0 ? 256 : game->reg.capacity * 2;
-        game->reg.entities = NOB_REALLOC(game->reg.entities, new_capacity * sizeof(*game->reg.entities));
-        NOB_ASSERT(game->reg.entities);
-        game->reg.capacity = new_capacity;
-    }
+size_t registry_index(const Registry *reg, Entity entity)
+{
+    if (entity.index >= reg->handle_count || reg->generations[entity.index] != entity.generation) return REGISTRY_NOT_FOUND;
+    return reg->slots[entity.index];
+}
 
-    TransformComponent transform = {
-        .position = {0, 0, 0},
-        .rotation = {0, 0, 0},
-        .scale = {1, 1, 1}
+bool entity_alive(const Registry *reg, Entity entity)
+{
+    return registry_index(reg, entity) != REGISTRY_NOT_FOUND;
+}
+
+Entity create_entity(Game *game) 
+{
+    MeshComponent mesh = {
+        .type = MESH_CUBE,
+        .color = RED
     };
-    
-    Model m = LoadModel(model_path);
-    if (m.meshCount == 0) {
-        TraceLog(LOG_ERROR, "GAME: Failed to load model from %s", model_path);
-    }
+    return spawn_one(game, mesh);
+}
+
+Entity create_entity_with_model(Game *game, const char* model_path) 
+{
     MeshComponent mesh = {
         .type = MESH_MODEL,
         .color = WHITE,
-        .model = m
+        .model = model_cache_acquire(&game->models, model_path)
     };
-    
-    EditorComponent editor = {
-        .is_selected = false,
-        .is_hovered = false
-    };
-    
-    entity.transform = transform;
-    entity.mesh = mesh;
-    entity.editor = editor;
-    game->reg.entities[game->reg.count] = entity;
-    game->reg.count++;
-    
+    Entity entity = spawn_one(game, mesh);
+    model_cache_release(&game->models, mesh.model);
     return entity;
 }
 
+bool destroy_entity(Game *game, Entity entity)
+{
+    Registry *reg = &game->reg;
+    size_t i = registry_index(reg, entity);
+    if (i == REGISTRY_NOT_FOUND) return false;
+
+    if (reg->meshes[i].type == MESH_MODEL) model_cache_release(&game->models, reg->meshes[i].model);
+
+    // Move the last entity into the hole and repoint its handle
+    size_t last = --reg->count;
+    if (i != last) {
+        reg->handles[i] = reg->handles[last];
+        reg->positions[i] = reg->positions[last];
+        reg->rotations[i] = reg->rotations[last];
+        reg->scales[i] = reg->scales[last];
+        reg->meshes[i] = reg->meshes[last];
+        reg->editors[i] = reg->editors[last];
+        reg->slots[reg->handles[i].index] = (uint32_t)i;
+    }
+
+    // Generation 0 marks ENTITY_INVALID, so it is skipped when the counter wraps
+    uint32_t *generation = &reg->generations[entity.index];
+    if (++*generation == 0) *generation = 1;
+    reg->free_list[reg->free_count++] = entity.index;
+    return true;
+}
+
 void game_free(Game *game) 
 {
-    NOB_FREE(game->reg.entities);
+    Registry *reg = &game->reg;
+    NOB_FREE(reg->handles);
+    NOB_FREE(reg->positions);
+    NOB_FREE(reg->rotations);
+    NOB_FREE(reg->scales);
+    NOB_FREE(reg->meshes);
+    NOB_FREE(reg->editors);
+    NOB_FREE(reg->generations);
+    NOB_FREE(reg->slots);
+    NOB_FREE(reg->free_list);
+    render_batches_free(&game->batches);
+    model_cache_free(&game->models);
     memset(game, 0, sizeof(Game));
 }
 
+// Draws one entity in immediate mode, for GLs without instancing. Returns
+// the draw calls it took.
+static int draw_entity(Game *game, size_t i, Color color)
+{
+    Registry *reg = &game->reg;
+    Vector3 position = reg->positions[i];
+    Vector3 scale = reg->scales[i];
+    MeshComponent *m = &reg->meshes[i];
+
+    switch (m->type) 
+    {
+        case MESH_CUBE:
+            DrawCube(position, scale.x, scale.y, scale.z, color);
+            DrawCubeWires(position, scale.x, scale.y, scale.z, MAROON);
+            return 2;
+        case MESH_SPHERE:
+            DrawSphere(position, scale.x, color);
+            DrawSphereWires(position, scale.x, 16, 16, MAROON);
+            return 2;
+        case MESH_PLANE:
+            DrawPlane(position, (Vector2){scale.x, scale.z}, color);
+            return 1;
+        case MESH_MODEL:
+        {
+            Model *model = model_cache_get(&game->models, m->model);
+            if (model == NULL) return 0;
+
+            // The model is shared, so the entity's rotation goes on a copy
+            Model oriented = *model;
+            oriented.transform = MatrixRotateXYZ(Vector3Scale(reg->rotations[i], DEG2RAD));
+            DrawModel(oriented, position, scale.x, WHITE);
+            return model->meshCount;
+        }
+    }
+    return 0;
+}
+
 void game_render(Game *game, Camera3D *camera)
 {
+    double start = GetTime();
+    RenderBatches *batches = &game->batches;
+    bool instanced = render_batches_begin(batches);
+
     BeginMode3D(*camera);
-    for (size_t i = 0; i < game->reg.count; ++i) 
+    Registry *reg = &game->reg;
+    for (size_t i = 0; i < reg->count; ++i) 
     {
-        TransformComponent *t = &game->reg.entities[i].transform;
-        MeshComponent *m = &game->reg.entities[i].mesh;
-        EditorComponent *e = &game->reg.entities[i].editor;
+        Vector3 position = reg->positions[i];
+        Vector3 scale = reg->scales[i];
+        MeshComponent *m = &reg->meshes[i];
+        EditorComponent *e = &reg->editors[i];
         
         Color color = m->color;
         if (e->is_selected) color = GREEN;
         else if (e->is_hovered) color = YELLOW;
-        
+
+        if (!instanced) {
+            batches->draw_calls += draw_entity(game, i, color);
+            continue;
+        }
+
+        // Same placement as DrawCube(), DrawSphere(), DrawPlane() and
+        // DrawModel() applied to unit meshes
+        Matrix translation = MatrixTranslate(position.x, position.y, position.z);
         switch (m->type) 
         {
             case MESH_CUBE:
-                DrawCube(t->position, t->scale.x, t->scale.y, t->scale.z, color);
-                DrawCubeWires(t->position, t->scale.x, t->scale.y, t->scale.z, MAROON);
+            {
+                Matrix transform = MatrixMultiply(MatrixScale(scale.x, scale.y, scale.z), translation);
+                render_batches_add(batches, BATCH_CUBE, transform, color);
+                render_batches_add(batches, BATCH_CUBE_WIRES, transform, MAROON);
                 break;
+            }
             case MESH_SPHERE:
-                DrawSphere(t->position, t->scale.x, color);
-                DrawSphereWires(t->position, t->scale.x, 16, 16, MAROON);
+            {
+                Matrix transform = MatrixMultiply(MatrixScale(scale.x, scale.x, scale.x), translation);
+                render_batches_add(batches, BATCH_SPHERE, transform, color);
+                render_batches_add(batches, BATCH_SPHERE_WIRES, transform, MAROON);
                 break;
+            }
             case MESH_PLANE:
-                DrawPlane(t->position, (Vector2){t->scale.x, t->scale.z}, color);
+                render_batches_add(batches, BATCH_PLANE, MatrixMultiply(MatrixScale(scale.x, 1.0f, scale.z), translation), color);
                 break;
             case MESH_MODEL:
-                DrawModel(m->model, t->position, t->scale.x, WHITE);
+            {
+                Matrix rotation = MatrixRotateXYZ(Vector3Scale(reg->rotations[i], DEG2RAD));
+                Matrix transform = MatrixMultiply(rotation, MatrixMultiply(MatrixScale(scale.x, scale.x, scale.x), translation));
+                render_batches_add_model(batches, m->model, transform, WHITE);
                 break;
-
+            }
         }
     }
+    render_batches_draw(batches, &game->models);
 
     //DrawGrid(10, 1.0f);
     EndMode3D();
+    batches->submit_ms = (GetTime() - start) * 1000.0;
 }
 
 void handle_input(Game *game, float timeDelta)
@@ -139,15 +290,18 @@ void handle_input(Game *game, float timeDelta)
     static float roll = 0.0f;
     static float yaw = 0.0f;
 
-    Entity *player = &game->reg.entities[0];
+    Registry *reg = &game->reg;
+    size_t player = registry_index(reg, game->player);
+    if (player == REGISTRY_NOT_FOUND) return;
+    Vector3 *position = &reg->positions[player];
     
     if (IsKeyDown(KEY_W)) {
         pitch += 0.6f;
-        player->transform.position.y -=  timeDelta * 30.0f;
+        position->y -=  timeDelta * 30.0f;
     }
     else if (IsKeyDown(KEY_S)) {
         pitch -= 0.6f;
-        player->transform.position.y +=  timeDelta * 30.0f;
+        position->y +=  timeDelta * 30.0f;
     }
     else{
         if (pitch > 0.3f) pitch -= 0.3f;
@@ -156,11 +310,11 @@ void handle_input(Game *game, float timeDelta)
 
     if (IsKeyDown(KEY_A)) {
         roll -=1.0f;
-        player->transform.position.x +=  timeDelta * 30.0f;
+        position->x +=  timeDelta * 30.0f;
     }
     else if (IsKeyDown(KEY_D)) {
         roll += 1.0f;
-        player->transform.position.x -=  timeDelta * 30.0f;
+        position->x -=  timeDelta * 30.0f;
     }
     else
     {
@@ -175,10 +329,10 @@ void handle_input(Game *game, float timeDelta)
        // position.y -= 10.0 * timeDelta;
     }
 
-    player->mesh.model.transform = MatrixRotateXYZ((Vector3){ DEG2RAD*pitch, DEG2RAD*yaw, DEG2RAD*roll });
+    reg->rotations[player] = (Vector3){ pitch, yaw, roll };
     
     // Constantly move player forward
-    player->transform.position.z += 10.0f * timeDelta;
+    position->z += 10.0f * timeDelta;
 
     // printf("%f, %f", pitch, roll);
 
@@ -255,54 +409,41 @@ void editor_update(Game *game, EditorState *editor, Camera3D *camera) {
     if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) 
     {
         bool hit_gizmo = false;
-        if (editor->selected_entity.id != ENTITY_INVALID) 
+        size_t idx = registry_index(reg, editor->selected_entity);
+        if (idx != REGISTRY_NOT_FOUND) 
         {
-            size_t idx = 0;
-            bool found = false;
-            for (size_t i = 0; i < reg->count; ++i) 
-            {
-                if (reg->entities[i].id == editor->selected_entity.id) 
-                {
-                    idx = i;
-                    found = true;
-                    break;
-                }
-            }
-            
-            if (found) 
-            {
-                GizmoAxis axis = check_gizmo_collision(ray, reg->entities[idx].transform.position);
-                if (axis != GIZMO_NONE) {
-                    editor->active_axis = axis;
-                    Vector3 axis_vec = {0};
-                    if (axis == GIZMO_X) axis_vec = (Vector3){1, 0, 0};
-                    if (axis == GIZMO_Y) axis_vec = (Vector3){0, 1, 0};
-                    if (axis == GIZMO_Z) axis_vec = (Vector3){0, 0, 1};
-                    
-                    editor->drag_entity_start_pos = reg->entities[idx].transform.position;
-                    editor->drag_start_t = get_axis_drag_t(ray, editor->drag_entity_start_pos, axis_vec);
-                    hit_gizmo = true;
-                }
+            GizmoAxis axis = check_gizmo_collision(ray, reg->positions[idx]);
+            if (axis != GIZMO_NONE) {
+                editor->active_axis = axis;
+                Vector3 axis_vec = {0};
+                if (axis == GIZMO_X) axis_vec = (Vector3){1, 0, 0};
+                if (axis == GIZMO_Y) axis_vec = (Vector3){0, 1, 0};
+                if (axis == GIZMO_Z) axis_vec = (Vector3){0, 0, 1};
+                
+                editor->drag_entity_start_pos = reg->positions[idx];
+                editor->drag_start_t = get_axis_drag_t(ray, editor->drag_entity_start_pos, axis_vec);
+                hit_gizmo = true;
             }
         }
         
         if (!hit_gizmo) 
         {
-            editor->selected_entity.id = ENTITY_INVALID;
+            editor->selected_entity = ENTITY_INVALID;
             editor->active_axis = GIZMO_NONE;
             for (size_t i = 0; i < reg->count; ++i) {
-                TransformComponent *t = &reg->entities[i].transform;
-                EditorComponent *e = &reg->entities[i].editor;
+                Vector3 p = reg->positions[i];
+                Vector3 sc = reg->scales[i];
+                EditorComponent *e = &reg->editors[i];
                 
                 BoundingBox box = {
-                    (Vector3){ t->position.x - t->scale.x/2, t->position.y - t->scale.y/2, t->position.z - t->scale.z/2 },
-                    (Vector3){ t->position.x + t->scale.x/2, t->position.y + t->scale.y/2, t->position.z + t->scale.z/2 }
+                    (Vector3){ p.x - sc.x/2, p.y - sc.y/2, p.z - sc.z/2 },
+                    (Vector3){ p.x + sc.x/2, p.y + sc.y/2, p.z + sc.z/2 }
                 };
                 
                 RayCollision collision = GetRayCollisionBox(ray, box);
                 if (collision.hit) {
                     e->is_selected = true;
-                    editor->selected_entity = reg->entities[i];
+                    editor->selected_entity = reg->handles[i];
                     break; // Select the first one hit
                 } else {
                     e->is_selected = false;
@@ -316,19 +457,10 @@ void editor_update(Game *game, EditorState *editor, Camera3D *camera) {
         editor->active_axis = GIZMO_NONE;
     }
     
-    if (editor->active_axis != GIZMO_NONE && editor->selected_entity.id != ENTITY_INVALID) 
+    if (editor->active_axis != GIZMO_NONE) 
     {
-        size_t idx = 0;
-        bool found = false;
-        for (size_t i = 0; i < reg->count; ++i) {
-            if (reg->entities[i].id == editor->selected_entity.id) {
-                idx = i;
-                found = true;
-                break;
-            }
-        }
-        
-        if (found) 
+        size_t idx = registry_index(reg, editor->selected_entity);
+        if (idx != REGISTRY_NOT_FOUND) 
         {
             Vector3 axis_vec = {0};
             if (editor->active_axis == GIZMO_X) axis_vec = (Vector3){1, 0, 0};
@@ -338,31 +470,18 @@ void editor_update(Game *game, EditorState *editor, Camera3D *camera) {
             float current_t = get_axis_drag_t(ray, editor->drag_entity_start_pos, axis_vec);
             float diff = current_t - editor->drag_start_t;
             
-            reg->entities[idx].transform.position = Vector3Add(editor->drag_entity_start_pos, Vector3Scale(axis_vec, diff));
+            reg->positions[idx] = Vector3Add(editor->drag_entity_start_pos, Vector3Scale(axis_vec, diff));
         }
     }
 }
 
 void system_editor_render(Registry *reg, EditorState *editor, Camera3D *camera) {
-    if (editor->selected_entity.id != ENTITY_INVALID) 
+    size_t idx = registry_index(reg, editor->selected_entity);
+    if (idx != REGISTRY_NOT_FOUND) 
     {
-        size_t idx = 0;
-        bool found = false;
-        for (size_t i = 0; i < reg->count; ++i) 
-        {
-            if (reg->entities[i].id == editor->selected_entity.id) 
-            {
-                idx = i;
-                found = true;
-                break;
-            }
-        }
-        if (found) 
-        {
-            BeginMode3D(*camera);
-            draw_gizmo(reg->entities[idx].transform.position, editor->active_axis);
-            EndMode3D();
-        }
+        BeginMode3D(*camera);
+        draw_gizmo(reg->positions[idx], editor->active_axis);
+        EndMode3D();
     }
 }
 
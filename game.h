@@ -3,20 +3,14 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <raylib.h>
+#include "model_cache.h"
+#include "render_batch.h"
 #include "nob.h"
 
 // --- ECS CORE ---
 
-#define ENTITY_INVALID 0
-
-typedef struct 
-{
-    Vector3 position;
-    Vector3 rotation; // Euler angles in degrees
-    Vector3 scale;
-} TransformComponent;
-
 typedef enum 
 {
     MESH_CUBE,
@@ -29,7 +23,7 @@ typedef struct
 {
     MeshType type;
     Color color;
-    Model model;
+    ModelHandle model; // MESH_MODEL only, a reference held in Game.models
 } MeshComponent;
 
 typedef struct 
@@ -38,29 +32,92 @@ typedef struct
     bool is_hovered;
 } EditorComponent;
 
+// Handle to an entity in a Registry: a slot in its handle table and the
+// generation that slot had when the entity was created. Destroying the
+// entity bumps the generation, so old copies of the handle stop resolving
+// even after the slot is reused. Generation 0 is never issued.
 typedef struct
 {
-    uint32_t id;
-    TransformComponent transform;
-    MeshComponent mesh;
-    EditorComponent editor;
-}Entity;
-
+    uint32_t index;
+    uint32_t generation;
+} Entity;
+
+#define ENTITY_INVALID ((Entity){ 0, 0 })
+
+// Components stored as one dense array per field, all indexed by the same
+// slot: slot i holds entity handles[i] and its position, rotation, scale,
+// mesh and editor state. Every entity has every component, so the arrays
+// stay in step and a system walks only the arrays it needs, e.g. a pass
+// over positions streams count contiguous Vector3s:
+//
+//     for (size_t i = 0; i < reg->count; ++i) reg->positions[i].z += dz;
+//
+// Destroying an entity moves the last one into its slot, so the arrays
+// stay packed. Slots therefore move; keep an Entity rather than pointers
+// into the arrays and look the slot up with registry_index().
 typedef struct 
 {
-    Entity *entities;
+    Entity *handles;
+    Vector3 *positions;
+    Vector3 *rotations; // Euler angles in degrees
+    Vector3 *scales;
+    MeshComponent *meshes;
+    EditorComponent *editors;
     size_t count;
     size_t capacity;
+
+    // Handle table: per handle index, its current generation and the slot
+    // holding its entity. Indices of destroyed entities wait in free_list.
+    uint32_t *generations;
+    uint32_t *slots;
+    size_t handle_count;
+    size_t handle_capacity;
+    uint32_t *free_list;
+    size_t free_count;
 } Registry;
 
 typedef struct
 {
     Registry reg;
+    ModelCache models;
+    RenderBatches batches; // entity draws, with last frame's draw calls and time
+    Entity player;
 }Game;
 
+// Initial components of spawned entities
+typedef struct
+{
+    Vector3 position;
+    Vector3 rotation;
+    Vector3 scale;
+    MeshComponent mesh;
+} EntityTemplate;
+
+#define REGISTRY_NOT_FOUND SIZE_MAX
+
+// Slot of an entity in the component arrays in O(1), REGISTRY_NOT_FOUND
+// for ENTITY_INVALID or a handle whose entity was destroyed
+size_t registry_index(const Registry *reg, Entity entity);
+
+bool entity_alive(const Registry *reg, Entity entity);
+
+// Bytes held by the registry's arrays, allocated capacity included
+size_t registry_memory_bytes(const Registry *reg);
+
 Game game_init(void);
 Entity create_entity(Game *game);
 Entity create_entity_with_model(Game *game, const char* model_path);
+
+// Creates count entities from one template, growing the arrays at most
+// once. Their handles are written to handles unless it is NULL. Entities
+// of a MESH_MODEL template share its model and take a reference each; the
+// caller keeps its own.
+void spawn_entities(Game *game, const EntityTemplate *tmpl, size_t count, Entity *handles);
+
+// Drops the entity's model reference and invalidates every handle to it. Returns
+// false for a stale or invalid handle.
+bool destroy_entity(Game *game, Entity entity);
+// Frees the registry and unloads every model and the render batches
 void game_free(Game *game);
 
 typedef enum 
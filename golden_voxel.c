@@ -0,0 +1,283 @@
+#define NOB_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "voxel_space_map.h"
+#include "voxel_renderer.h"
+#include "terrain.h"
+#include <math.h>
+#include <string.h>
+
+// Golden-image check for the software voxel renderer. Renders a fixed set
+// of camera poses headlessly and compares them with the reference images
+// in GOLDEN_FOLDER. Exits non-zero if any pose is out of tolerance, after
+// writing the rendered image and an amplified diff to GOLDEN_OUTPUT_FOLDER.
+//
+//   golden_voxel --record                 write the references (exact path)
+//   golden_voxel                          compare exactly
+//   golden_voxel --kernel fixed --approx  compare within the fixed-point budget
+//
+// Options: --kernel NAME, --threads N, --lod START, --zfar D, --skip-empty,
+// --column-major, --palettized, --tolerance N (max channel difference of a
+// matching pixel), --max-bad-permille P (pixels allowed over the tolerance,
+// per 1000) and --min-psnr DB. --approx sets the last three to the fixed-point
+// kernel's documented budget.
+
+#define GOLDEN_FOLDER "resources/golden/"
+#define GOLDEN_OUTPUT_FOLDER "build/golden/"
+
+typedef struct
+{
+    const char *name;
+    int map;
+    Vector3 position;
+    Vector3 target;
+    float tilt;
+} GoldenPose;
+
+// Spread over maps with different terrain: low and high views, looking
+// along both axes and diagonally, and one with a tilted horizon
+static const GoldenPose poses[] = {
+    { "map0_valley",   0,  { 512.0f, 180.0f, 512.0f }, { 542.0f, 165.0f, 512.0f }, 0.0f },
+    { "map3_diagonal", 3,  { 200.0f, 240.0f, 200.0f }, { 221.0f, 225.0f, 221.0f }, 0.0f },
+    { "map7_high",     7,  { 700.0f, 400.0f, 300.0f }, { 700.0f, 370.0f, 330.0f }, 0.0f },
+    { "map12_low",     12, { 100.0f, 120.0f, 900.0f }, { 70.0f,  118.0f, 900.0f }, 0.0f },
+    { "map20_tilted",  20, { 512.0f, 220.0f, 100.0f }, { 530.0f, 205.0f, 124.0f }, 2.5f },
+    { "map28_north",   28, { 300.0f, 260.0f, 800.0f }, { 300.0f, 245.0f, 770.0f }, 0.0f },
+};
+
+#define POSE_COUNT ((int)(sizeof(poses) / sizeof(poses[0])))
+
+typedef struct
+{
+    bool record;
+    VoxelKernel kernel;
+    int threads;
+    int tolerance;
+    double maxBadPermille;
+    double minPsnr;
+    VoxelRenderConfig config;
+} GoldenOptions;
+
+typedef struct
+{
+    int maxDifference;
+    int badPixels;
+    double badPermille;
+    double psnr; // INFINITY for identical images
+} Comparison;
+
+static bool parse_kernel(const char *name, VoxelKernel *kernel)
+{
+    for (int k = 0; k < VOXEL_KERNEL_COUNT; k++) {
+        if (strcmp(name, voxel_kernel_name((VoxelKernel)k)) == 0) {
+            *kernel = (VoxelKernel)k;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_options(int argc, char **argv, GoldenOptions *options)
+{
+    *options = (GoldenOptions){
+        .kernel = VOXEL_KERNEL_AUTO,
+        .threads = 0,
+        .tolerance = 0,
+        .maxBadPermille = 0.0,
+        .minPsnr = INFINITY,
+        .config = voxel_render_config_default(),
+    };
+    // Opaque sky, so the references do not depend on the clear color
+    options->config.sky = (Color){ 0, 0, 0, 255 };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--record") == 0) {
+            options->record = true;
+            continue;
+        }
+        if (strcmp(arg, "--skip-empty") == 0) {
+            options->config.skipEmpty = true;
+            continue;
+        }
+        if (strcmp(arg, "--column-major") == 0) {
+            options->config.columnMajor = true;
+            continue;
+        }
+        if (strcmp(arg, "--palettized") == 0) {
+            options->config.palettized = true;
+            continue;
+        }
+        if (strcmp(arg, "--approx") == 0) {
+            options->tolerance = VOXEL_FIXED_TOLERANCE;
+            options->maxBadPermille = VOXEL_FIXED_TOLERANCE_PERMILLE;
+            options->minPsnr = 30.0;
+            continue;
+        }
+        if (value == NULL) {
+            fprintf(stderr, "golden_voxel: unknown option or missing value: %s\n", arg);
+            return false;
+        }
+
+        i++;
+        if (strcmp(arg, "--threads") == 0) options->threads = atoi(value);
+        else if (strcmp(arg, "--tolerance") == 0) options->tolerance = atoi(value);
+        else if (strcmp(arg, "--max-bad-permille") == 0) options->maxBadPermille = atof(value);
+        else if (strcmp(arg, "--min-psnr") == 0) options->minPsnr = atof(value);
+        else if (strcmp(arg, "--zfar") == 0) options->config.zfar = (float)atof(value);
+        else if (strcmp(arg, "--lod") == 0) {
+            options->config.lod = true;
+            options->config.lodStart = atoi(value);
+        } else if (strcmp(arg, "--kernel") == 0) {
+            if (!parse_kernel(value, &options->kernel)) {
+                fprintf(stderr, "golden_voxel: unknown kernel %s\n", value);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "golden_voxel: unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    // References always come from the exact path
+    if (options->record && (options->kernel == VOXEL_KERNEL_FIXED || options->config.lod)) {
+        fprintf(stderr, "golden_voxel: record with an exact kernel and without --lod\n");
+        return false;
+    }
+    return true;
+}
+
+static Image pixels_image(Color *pixels)
+{
+    return (Image){
+        .data = pixels,
+        .width = RENDER_WIDTH,
+        .height = RENDER_HEIGHT,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        .mipmaps = 1,
+    };
+}
+
+static Comparison compare_images(const Color *actual, const Color *expected, int tolerance, Color *diff)
+{
+    Comparison result = { 0 };
+    double squaredError = 0.0;
+
+    for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++) {
+        int dr = abs(actual[i].r - expected[i].r);
+        int dg = abs(actual[i].g - expected[i].g);
+        int db = abs(actual[i].b - expected[i].b);
+        int da = abs(actual[i].a - expected[i].a);
+        int d = dr > dg ? dr : dg;
+        if (db > d) d = db;
+        if (da > d) d = da;
+
+        squaredError += dr * dr + dg * dg + db * db;
+        if (d > result.maxDifference) result.maxDifference = d;
+        if (d > tolerance) result.badPixels++;
+
+        // Out-of-tolerance pixels in red, smaller differences amplified in grey
+        unsigned char level = (unsigned char)(d * 8 > 255 ? 255 : d * 8);
+        diff[i] = d > tolerance ? (Color){ 255, 0, 0, 255 } : (Color){ level, level, level, 255 };
+    }
+
+    double mse = squaredError / (3.0 * RENDER_WIDTH * RENDER_HEIGHT);
+    result.psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+    result.badPermille = result.badPixels * 1000.0 / (RENDER_WIDTH * RENDER_HEIGHT);
+    return result;
+}
+
+// Renders one pose; returns false if its map could not be loaded
+static bool render_pose(VoxelRenderer *renderer, Terrain *terrain, const GoldenPose *pose)
+{
+    char colorPath[64];
+    char heightPath[64];
+    snprintf(colorPath, sizeof(colorPath), "resources/map%d.color.gif", pose->map);
+    snprintf(heightPath, sizeof(heightPath), "resources/map%d.height.gif", pose->map);
+    if (!terrain_load(terrain, colorPath, heightPath)) return false;
+    if (renderer->config.palettized) terrain_build_indices(terrain);
+
+    renderer->config.tilt = pose->tilt;
+    voxel_renderer_render(renderer, (Camera3D){ .position = pose->position, .target = pose->target, .up = { 0.0f, 1.0f, 0.0f } });
+    return true;
+}
+
+// Compares a rendered pose with its reference; writes the failure images
+static bool check_pose(const GoldenOptions *options, const GoldenPose *pose, Color *pixels, Color *diff)
+{
+    const char *referencePath = temp_sprintf(GOLDEN_FOLDER"%s.png", pose->name);
+    Image reference = LoadImage(referencePath);
+    if (reference.data == NULL || reference.width != RENDER_WIDTH || reference.height != RENDER_HEIGHT) {
+        printf("FAIL %-14s missing or mis-sized reference %s, run with --record\n", pose->name, referencePath);
+        UnloadImage(reference);
+        return false;
+    }
+
+    Color *expected = LoadImageColors(reference);
+    Comparison result = compare_images(pixels, expected, options->tolerance, diff);
+    UnloadImageColors(expected);
+    UnloadImage(reference);
+
+    bool passed = result.badPermille <= options->maxBadPermille && result.psnr >= options->minPsnr;
+    printf("%s %-14s max diff %3d, over tolerance %7d px (%.3f per 1000), PSNR %.2f dB\n",
+           passed ? "PASS" : "FAIL", pose->name, result.maxDifference, result.badPixels,
+           result.badPermille, result.psnr);
+
+    if (!passed) {
+        ExportImage(pixels_image(pixels), temp_sprintf(GOLDEN_OUTPUT_FOLDER"%s.actual.png", pose->name));
+        ExportImage(pixels_image(diff), temp_sprintf(GOLDEN_OUTPUT_FOLDER"%s.diff.png", pose->name));
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    GoldenOptions options;
+    if (!parse_options(argc, argv, &options)) return 1;
+
+    SetTraceLogLevel(LOG_WARNING);
+    if (!mkdir_if_not_exists(options.record ? GOLDEN_FOLDER : GOLDEN_OUTPUT_FOLDER)) return 1;
+
+    static Color pixels[RENDER_WIDTH * RENDER_HEIGHT];
+    static Color diff[RENDER_WIDTH * RENDER_HEIGHT];
+    static VoxelRenderer renderer;
+    Terrain terrain = { 0 };
+
+    if (!voxel_renderer_init(&renderer, &terrain, pixels, options.config)) return 1;
+    if (options.threads != 0) voxel_renderer_set_threads(&renderer, options.threads);
+    voxel_renderer_set_kernel(&renderer, options.kernel);
+
+    int failures = 0;
+    for (int i = 0; i < POSE_COUNT; i++) {
+        const GoldenPose *pose = &poses[i];
+        size_t mark = temp_save();
+
+        if (!render_pose(&renderer, &terrain, pose)) {
+            printf("FAIL %-14s could not load map %d\n", pose->name, pose->map);
+            failures++;
+        } else if (options.record) {
+            const char *path = temp_sprintf(GOLDEN_FOLDER"%s.png", pose->name);
+            if (ExportImage(pixels_image(pixels), path)) {
+                printf("recorded %s\n", path);
+            } else {
+                printf("FAIL %-14s could not write %s\n", pose->name, path);
+                failures++;
+            }
+        } else if (!check_pose(&options, pose, pixels, diff)) {
+            failures++;
+        }
+
+        temp_rewind(mark);
+    }
+
+    if (!options.record) {
+        printf("%d of %d poses passed (kernel %s)\n", POSE_COUNT - failures, POSE_COUNT, voxel_kernel_name(renderer.kernel));
+    }
+
+    voxel_renderer_free(&renderer);
+    terrain_unload(&terrain);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#include "heap_stats.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#ifdef HEAP_COUNTING
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+// glibc's own entry points, which its malloc() and friends forward to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+#endif
+
+static atomic_size_t heapAllocations = 0;
+
+// Defined in the program, these take the place of the C library's for
+// every caller the linker binds to them, and forward to the real allocator
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&heapAllocations, 1, memory_order_relaxed);
+#if defined(__APPLE__)
+    return malloc_zone_malloc(malloc_default_zone(), size);
+#else
+    return __libc_malloc(size);
+#endif
+}
+
+void *calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&heapAllocations, 1, memory_order_relaxed);
+#if defined(__APPLE__)
+    return malloc_zone_calloc(malloc_default_zone(), count, size);
+#else
+    return __libc_calloc(count, size);
+#endif
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&heapAllocations, 1, memory_order_relaxed);
+#if defined(__APPLE__)
+    // The block may come from a framework's zone rather than the default one
+    malloc_zone_t *zone = ptr ? malloc_zone_from_ptr(ptr) : malloc_default_zone();
+    return malloc_zone_realloc(zone ? zone : malloc_default_zone(), ptr, size);
+#else
+    return __libc_realloc(ptr, size);
+#endif
+}
+
+size_t heap_allocation_count(void)
+{
+    return atomic_load_explicit(&heapAllocations, memory_order_relaxed);
+}
+
+bool heap_counting_enabled(void)
+{
+    return true;
+}
+
+#else
+
+size_t heap_allocation_count(void)
+{
+    return 0;
+}
+
+bool heap_counting_enabled(void)
+{
+    return false;
+}
+
+#endif // HEAP_COUNTING
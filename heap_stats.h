@@ -0,0 +1,16 @@
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Calls to malloc(), calloc() and realloc() made so far by any thread of
+// the program. Counted only in a build with HEAP_COUNTING defined, where
+// heap_stats.c wraps those functions; 0 otherwise. On macOS the wrappers
+// see the program's own code and static libraries, not system frameworks.
+size_t heap_allocation_count(void);
+
+// Whether this build counts allocations
+bool heap_counting_enabled(void);
+
+#endif // HEAP_STATS_H
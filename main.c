@@ -5,6 +5,7 @@
 #include "camera.h"
 #include "colors.h"
 #include "voxel_space_map.h"
+#include "heap_stats.h"
 
 #define NOB_IMPLEMENTATION
 #define NOB_STRIP_PREFIX
@@ -18,13 +19,11 @@
 
 int main(void)
 {
-    Entity* player = NULL;
-
     // Initialize Registry and Editor State
     Game game = game_init();
     EditorState editor = {0};
     editor.active_axis = GIZMO_NONE;
-    editor.selected_entity.id = ENTITY_INVALID;
+    editor.selected_entity = ENTITY_INVALID;
 
     init_camera();
 
@@ -35,13 +34,13 @@ int main(void)
     SetTargetFPS(60);
 
     // Add some initial entities (MUST BE AFTER InitWindow for models to load)
-    create_entity_with_model(&game, "resources/models/aircraft.glb");
-    game.reg.entities[0].transform.position = (Vector3){512, 150, 512};
-    game.reg.entities[0].mesh.color = WHITE;
-    player = &game.reg.entities[0];
+    game.player = create_entity_with_model(&game, "resources/models/aircraft.glb");
+    size_t player_index = registry_index(&game.reg, game.player);
+    game.reg.positions[player_index] = (Vector3){512, 150, 512};
+    game.reg.meshes[player_index].color = WHITE;
 
-    //set_camera_target(game.reg.entities[0].transform.position);
-    set_camera_target(player->transform.position);
+    //set_camera_target(game.reg.positions[0]);
+    set_camera_target(game.reg.positions[player_index]);
 
     init_map();
 
@@ -54,16 +53,23 @@ int main(void)
 
         if(IsKeyReleased(KEY_M))
         {
-            current_map = ((1 + get_current_map())  % NUM_MAPS); 
+            // Counts from the last request, the current map lags while loading
+            current_map = ((1 + current_map)  % NUM_MAPS); 
             nob_log(NOB_INFO, "Map Changed : %d" , current_map);
             change_map(current_map);
         }
 
+        if(IsKeyReleased(KEY_T))
+        {
+            // Single map, tiled maps, generated terrain
+            set_render_world((get_render_world() + 1) % (WORLD_GENERATED + 1));
+        }
+
         ////////////////////////////////////
         // Update
         game_update(&game, GetFrameTime());
-        //set_camera_target(game.reg.entities[0].transform.position);
-        set_camera_target(player->transform.position);
+        //set_camera_target(game.reg.positions[0]);
+        set_camera_target(game.reg.positions[registry_index(&game.reg, game.player)]);
         update_camera();
         
         // Render
@@ -76,15 +82,31 @@ int main(void)
             //system_editor_render(&reg, &editor, get_camera());
             DrawFPS(10, 10);
             char buf[256];
-            sprintf(buf, "Selected map : %d ", get_current_map());
+            sprintf(buf, "Selected map : %d %s", get_current_map(), is_map_loading() ? "(loading)" : "");
             DrawText(buf, 10, 30, 20, WHITE);
+            if (heap_counting_enabled()) sprintf(buf, "Map heap allocs/frame : %zu ", get_map_frame_allocations());
+            else sprintf(buf, "Map heap allocs/frame : not counted ");
+            DrawText(buf, 10, 50, 20, WHITE);
+            sprintf(buf, "Ray steps/frame : %lld ", get_map_frame_ray_steps());
+            DrawText(buf, 10, 70, 20, WHITE);
+            sprintf(buf, "Map load : %.1f ms ", get_map_load_latency_ms());
+            DrawText(buf, 10, 90, 20, WHITE);
+            sprintf(buf, "Models : %d resident, %.1f MB ", model_cache_resident_models(&game.models), game.models.resident_bytes / (1024.0 * 1024.0));
+            DrawText(buf, 10, 110, 20, WHITE);
+            sprintf(buf, "Entity draws : %d (%.2f ms) ", game.batches.draw_calls, game.batches.submit_ms);
+            DrawText(buf, 10, 130, 20, WHITE);
+            if (get_render_world() != WORLD_SINGLE_MAP) {
+                sprintf(buf, "Tiles resident/missing : %d/%d (%.0f/s) ", get_map_resident_tiles(), get_map_missing_tiles(), get_map_tiles_per_second());
+                DrawText(buf, 10, 150, 20, WHITE);
+            }
             
         EndDrawing();
     }
 
+    // Models are unloaded while the GL context still exists
+    game_free(&game);
     CloseWindow();
     cleanup_map();
-    game_free(&game);
 
     return 0;
 }
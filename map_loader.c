@@ -0,0 +1,143 @@
+#include "map_loader.h"
+#include <raylib.h>
+#include <stdio.h>
+#include <time.h>
+
+static uint64_t now_nanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void *loader_main(void *arg)
+{
+    MapLoader *loader = (MapLoader *)arg;
+
+    pthread_mutex_lock(&loader->mutex);
+    for (;;) {
+        while (!loader->quit && loader->requestedMap < 0) {
+            pthread_cond_wait(&loader->wake, &loader->mutex);
+        }
+        if (loader->quit) break;
+
+        int map = loader->requestedMap;
+        uint64_t requestedAt = loader->requestedAt;
+        char colorPath[MAP_LOADER_PATH_LENGTH];
+        char heightPath[MAP_LOADER_PATH_LENGTH];
+        snprintf(colorPath, sizeof(colorPath), "%s", loader->colorPath);
+        snprintf(heightPath, sizeof(heightPath), "%s", loader->heightPath);
+        loader->requestedMap = -1;
+        loader->loading = true;
+        pthread_mutex_unlock(&loader->mutex);
+
+        // The slow part, mapping the cooked terrain or decoding the GIFs, runs unlocked
+        Terrain terrain = { 0 };
+        uint64_t start = now_nanos();
+        bool loaded = terrain_load_cached(&terrain, colorPath, heightPath);
+        double decodeMs = (now_nanos() - start) / 1e6;
+
+        pthread_mutex_lock(&loader->mutex);
+        loader->loading = false;
+        if (!loaded) {
+            TraceLog(LOG_WARNING, "MAP: Could not load map %d, keeping the current one", map);
+            continue;
+        }
+        if (loader->requestedMap >= 0 || loader->quit) {
+            // Superseded while it was loading
+            terrain_unload(&terrain);
+            continue;
+        }
+
+        // Replaces a finished load nobody has picked up yet
+        if (atomic_load(&loader->ready)) terrain_unload(&loader->loaded);
+        loader->loaded = terrain;
+        loader->loadedMap = map;
+        loader->loadedRequestedAt = requestedAt;
+        loader->loadedDecodeMs = decodeMs;
+        atomic_store(&loader->ready, true);
+    }
+    pthread_mutex_unlock(&loader->mutex);
+
+    return NULL;
+}
+
+bool map_loader_start(MapLoader *loader)
+{
+    *loader = (MapLoader){ 0 };
+    loader->requestedMap = -1;
+    atomic_init(&loader->ready, false);
+    pthread_mutex_init(&loader->mutex, NULL);
+    pthread_cond_init(&loader->wake, NULL);
+
+    if (pthread_create(&loader->thread, NULL, loader_main, loader) != 0) {
+        TraceLog(LOG_WARNING, "MAP: Failed to start the map loader thread");
+        pthread_cond_destroy(&loader->wake);
+        pthread_mutex_destroy(&loader->mutex);
+        return false;
+    }
+    loader->running = true;
+    return true;
+}
+
+void map_loader_stop(MapLoader *loader)
+{
+    if (!loader->running) return;
+
+    pthread_mutex_lock(&loader->mutex);
+    loader->quit = true;
+    pthread_cond_signal(&loader->wake);
+    pthread_mutex_unlock(&loader->mutex);
+    pthread_join(loader->thread, NULL);
+
+    if (atomic_load(&loader->ready)) terrain_unload(&loader->loaded);
+    atomic_store(&loader->ready, false);
+    pthread_cond_destroy(&loader->wake);
+    pthread_mutex_destroy(&loader->mutex);
+    loader->running = false;
+}
+
+void map_loader_request(MapLoader *loader, int map, const char *colorPath, const char *heightPath)
+{
+    if (!loader->running) return;
+
+    pthread_mutex_lock(&loader->mutex);
+    loader->requestedMap = map;
+    snprintf(loader->colorPath, sizeof(loader->colorPath), "%s", colorPath);
+    snprintf(loader->heightPath, sizeof(loader->heightPath), "%s", heightPath);
+    loader->requestedAt = now_nanos();
+    pthread_cond_signal(&loader->wake);
+    pthread_mutex_unlock(&loader->mutex);
+}
+
+bool map_loader_poll(MapLoader *loader, Terrain *terrain, MapLoadStats *stats)
+{
+    // Checked without the lock, so frames without a finished load stay lock-free
+    if (!loader->running || !atomic_load(&loader->ready)) return false;
+
+    pthread_mutex_lock(&loader->mutex);
+    terrain_unload(terrain);
+    *terrain = loader->loaded;
+    loader->loaded = (Terrain){ 0 };
+    atomic_store(&loader->ready, false);
+
+    if (stats) {
+        *stats = (MapLoadStats){
+            .map = loader->loadedMap,
+            .decodeMs = loader->loadedDecodeMs,
+            .latencyMs = (now_nanos() - loader->loadedRequestedAt) / 1e6,
+        };
+    }
+    pthread_mutex_unlock(&loader->mutex);
+    return true;
+}
+
+bool map_loader_busy(MapLoader *loader)
+{
+    if (!loader->running) return false;
+
+    pthread_mutex_lock(&loader->mutex);
+    bool busy = loader->requestedMap >= 0 || loader->loading || atomic_load(&loader->ready);
+    pthread_mutex_unlock(&loader->mutex);
+    return busy;
+}
@@ -0,0 +1,63 @@
+#ifndef MAP_LOADER_H
+#define MAP_LOADER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "terrain.h"
+
+#define MAP_LOADER_PATH_LENGTH 64
+
+// Decodes terrains on a background thread, so switching maps does not stall
+// the frame that asked for it. Only the newest request matters: one that
+// arrives while another is loading replaces it, and the older result is
+// thrown away. The render thread picks up a finished terrain with
+// map_loader_poll() at a point where nothing is reading the current one.
+typedef struct
+{
+    pthread_t thread;
+    bool running;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    bool quit;
+
+    // Waiting request, map -1 if none
+    int requestedMap;
+    char colorPath[MAP_LOADER_PATH_LENGTH];
+    char heightPath[MAP_LOADER_PATH_LENGTH];
+    uint64_t requestedAt;
+    bool loading;
+
+    // Finished load, handed over by map_loader_poll()
+    atomic_bool ready;
+    Terrain loaded;
+    int loadedMap;
+    uint64_t loadedRequestedAt;
+    double loadedDecodeMs;
+} MapLoader;
+
+// Timing of a completed map switch
+typedef struct
+{
+    int map;
+    double decodeMs;  // spent in terrain_load() on the loader thread
+    double latencyMs; // from map_loader_request() until map_loader_poll() took it
+} MapLoadStats;
+
+bool map_loader_start(MapLoader *loader);
+
+// Joins the thread and drops any load that was not picked up
+void map_loader_stop(MapLoader *loader);
+
+void map_loader_request(MapLoader *loader, int map, const char *colorPath, const char *heightPath);
+
+// Never blocks on a load. If one has finished, replaces *terrain with it,
+// unloading the old one, and returns true.
+bool map_loader_poll(MapLoader *loader, Terrain *terrain, MapLoadStats *stats);
+
+// True from a request until its terrain has been polled or its load failed
+bool map_loader_busy(MapLoader *loader);
+
+#endif // MAP_LOADER_H
@@ -0,0 +1,145 @@
+#include "model_cache.h"
+#include <rlgl.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Material maps raylib names; materials allocate at least this many
+#define MATERIAL_MAP_COUNT (MATERIAL_MAP_BRDF + 1)
+
+static ModelCacheEntry *entry_of(ModelCache *cache, ModelHandle handle)
+{
+    if (handle.index >= cache->count) return NULL;
+    ModelCacheEntry *entry = &cache->entries[handle.index];
+    return entry->path && entry->generation == handle.generation ? entry : NULL;
+}
+
+// CPU copies of the mesh arrays, which raylib keeps after upload, plus
+// one copy of each distinct texture the materials use
+static size_t model_bytes(const Model *model)
+{
+    size_t bytes = 0;
+    for (int i = 0; i < model->meshCount; i++) {
+        const Mesh *mesh = &model->meshes[i];
+        size_t vertices = (size_t)mesh->vertexCount;
+        if (mesh->vertices) bytes += vertices * 3 * sizeof(float);
+        if (mesh->texcoords) bytes += vertices * 2 * sizeof(float);
+        if (mesh->texcoords2) bytes += vertices * 2 * sizeof(float);
+        if (mesh->normals) bytes += vertices * 3 * sizeof(float);
+        if (mesh->tangents) bytes += vertices * 4 * sizeof(float);
+        if (mesh->colors) bytes += vertices * 4;
+        if (mesh->indices) bytes += (size_t)mesh->triangleCount * 3 * sizeof(unsigned short);
+        if (mesh->animVertices) bytes += vertices * 3 * sizeof(float);
+        if (mesh->animNormals) bytes += vertices * 3 * sizeof(float);
+        if (mesh->boneIds) bytes += vertices * 4;
+        if (mesh->boneWeights) bytes += vertices * 4 * sizeof(float);
+    }
+
+    // Materials often share textures, so each texture id is counted once
+    unsigned int counted[64];
+    int counted_count = 0;
+    for (int i = 0; i < model->materialCount; i++) {
+        const MaterialMap *maps = model->materials[i].maps;
+        for (int map = 0; maps && map < MATERIAL_MAP_COUNT; map++) {
+            Texture2D texture = maps[map].texture;
+            if (texture.id == 0 || texture.id == rlGetTextureIdDefault()) continue;
+
+            bool seen = false;
+            for (int j = 0; j < counted_count && !seen; j++) seen = counted[j] == texture.id;
+            if (seen) continue;
+            if (counted_count < (int)(sizeof(counted) / sizeof(counted[0]))) counted[counted_count++] = texture.id;
+            bytes += (size_t)GetPixelDataSize(texture.width, texture.height, texture.format);
+        }
+    }
+    return bytes;
+}
+
+ModelHandle model_cache_acquire(ModelCache *cache, const char *path)
+{
+    size_t free_index = cache->count;
+    for (size_t i = 0; i < cache->count; ++i) {
+        ModelCacheEntry *entry = &cache->entries[i];
+        if (entry->path == NULL) {
+            if (free_index == cache->count) free_index = i;
+        } else if (strcmp(entry->path, path) == 0) {
+            entry->ref_count++;
+            return (ModelHandle){ (uint32_t)i, entry->generation };
+        }
+    }
+
+    Model model = LoadModel(path);
+    cache->loads++;
+    if (model.meshCount == 0) {
+        TraceLog(LOG_ERROR, "GAME: Failed to load model from %s", path);
+    }
+
+    if (free_index == cache->count) {
+        if (cache->count >= cache->capacity) {
+            size_t new_capacity = cache->capacity == 0 ? 16 : cache->capacity * 2;
+            ModelCacheEntry *entries = realloc(cache->entries, new_capacity * sizeof(*entries));
+            if (entries == NULL) {
+                TraceLog(LOG_ERROR, "GAME: Out of memory for model %s", path);
+                UnloadModel(model);
+                return MODEL_HANDLE_NONE;
+            }
+            cache->entries = entries;
+            cache->capacity = new_capacity;
+        }
+        cache->entries[cache->count++] = (ModelCacheEntry){ .generation = 1 };
+    }
+
+    ModelCacheEntry *entry = &cache->entries[free_index];
+    *entry = (ModelCacheEntry){
+        .path = strdup(path),
+        .model = model,
+        .ref_count = 1,
+        .bytes = model_bytes(&model),
+        .generation = entry->generation,
+    };
+    cache->resident_bytes += entry->bytes;
+    return (ModelHandle){ (uint32_t)free_index, entry->generation };
+}
+
+void model_cache_retain(ModelCache *cache, ModelHandle handle, size_t count)
+{
+    ModelCacheEntry *entry = entry_of(cache, handle);
+    if (entry) entry->ref_count += (int)count;
+}
+
+void model_cache_release(ModelCache *cache, ModelHandle handle)
+{
+    ModelCacheEntry *entry = entry_of(cache, handle);
+    if (entry == NULL || --entry->ref_count > 0) return;
+
+    UnloadModel(entry->model);
+    cache->resident_bytes -= entry->bytes;
+    free(entry->path);
+
+    // Handles to the unloaded model stop resolving; 0 is never issued
+    uint32_t generation = entry->generation + 1;
+    *entry = (ModelCacheEntry){ .generation = generation == 0 ? 1 : generation };
+}
+
+Model *model_cache_get(ModelCache *cache, ModelHandle handle)
+{
+    ModelCacheEntry *entry = entry_of(cache, handle);
+    return entry ? &entry->model : NULL;
+}
+
+int model_cache_resident_models(const ModelCache *cache)
+{
+    int resident = 0;
+    for (size_t i = 0; i < cache->count; ++i) resident += cache->entries[i].path != NULL;
+    return resident;
+}
+
+void model_cache_free(ModelCache *cache)
+{
+    for (size_t i = 0; i < cache->count; ++i) {
+        ModelCacheEntry *entry = &cache->entries[i];
+        if (entry->path == NULL) continue;
+        UnloadModel(entry->model);
+        free(entry->path);
+    }
+    free(cache->entries);
+    *cache = (ModelCache){ 0 };
+}
@@ -0,0 +1,58 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <raylib.h>
+
+// Refers to a model in a ModelCache: its entry and the generation that
+// entry had when the model was loaded. Unloading bumps the generation, so
+// a stale handle stops resolving even after the entry holds another model.
+// Generation 0 is never issued.
+typedef struct
+{
+    uint32_t index;
+    uint32_t generation;
+} ModelHandle;
+
+#define MODEL_HANDLE_NONE ((ModelHandle){ 0, 0 })
+
+typedef struct
+{
+    char *path; // NULL for a free entry
+    Model model;
+    int ref_count;
+    size_t bytes; // mesh data and textures, estimated at load
+    uint32_t generation;
+} ModelCacheEntry;
+
+// Models loaded once per path and shared. Each acquire or retain adds a
+// reference and each release drops one; the model is unloaded with its
+// last reference. Needs a window, like LoadModel().
+typedef struct
+{
+    ModelCacheEntry *entries;
+    size_t count;
+    size_t capacity;
+    size_t resident_bytes;
+    size_t loads; // LoadModel() calls so far
+} ModelCache;
+
+// Takes a reference to the model at path, loading it if no one holds it
+ModelHandle model_cache_acquire(ModelCache *cache, const char *path);
+
+// Adds count references to a model already held
+void model_cache_retain(ModelCache *cache, ModelHandle handle, size_t count);
+
+void model_cache_release(ModelCache *cache, ModelHandle handle);
+
+// NULL for MODEL_HANDLE_NONE or a model no longer held
+Model *model_cache_get(ModelCache *cache, ModelHandle handle);
+
+int model_cache_resident_models(const ModelCache *cache);
+
+// Unloads every model, whatever its references
+void model_cache_free(ModelCache *cache);
+
+#endif // MODEL_CACHE_H
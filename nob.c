@@ -6,24 +6,79 @@ Cmd cmd = {0};
 
 #define BUILD_FOLDER  "build/"
 
+// Renderer sources shared by the game and the benchmarks
+#define VOXEL_SOURCES "camera.c", "voxel_space_map.c", "voxel_renderer.c", "terrain.c", "worker_pool.c", "voxel_kernels.c", "map_loader.c", "tile_cache.c", "terrain_gen.c", "heap_stats.c"
+
+static void append_compiler(Cmd *cmd)
+{
+    cmd_append(cmd, "clang");
+    cmd_append(cmd, "-framework", "CoreVideo");
+    cmd_append(cmd, "-framework", "IOKit");
+    cmd_append(cmd, "-framework", "Cocoa");
+    cmd_append(cmd, "-framework", "GLUT");
+    cmd_append(cmd, "-framework", "OpenGL");
+    cmd_append(cmd, "-I./raylib-5.5_macos/include/");
+    // Keep scalar and SIMD column kernels bit-identical (no implicit FMA contraction)
+    cmd_append(cmd, "-ffp-contract=off");
+}
+
+static void append_libraries(Cmd *cmd)
+{
+    cmd_append(cmd, "./raylib-5.5_macos/lib/libraylib.a");
+    cmd_append(cmd, "-lm");
+}
+
 int main(int argc, char **argv)
 {
     NOB_GO_REBUILD_URSELF(argc, argv);
 
    if (!nob_mkdir_if_not_exists(BUILD_FOLDER)) return 1;
 
-    cmd_append(&cmd, "clang");
-    cmd_append(&cmd, "-framework", "CoreVideo");
-    cmd_append(&cmd, "-framework", "IOKit");
-    cmd_append(&cmd, "-framework", "Cocoa");
-    cmd_append(&cmd, "-framework", "GLUT");
-    cmd_append(&cmd, "-framework", "OpenGL");
-    cmd_append(&cmd, "-I./raylib-5.5_macos/include/");
-    cmd_append(&cmd, "-o", BUILD_FOLDER"main", "main.c", "game.c", "camera.c", "voxel_space_map.c");
-    cmd_append(&cmd, "./raylib-5.5_macos/lib/libraylib.a");
-    cmd_append(&cmd, "-lm");
-    
+    append_compiler(&cmd);
+    // Counts every malloc() for the HUD's allocations per frame
+    cmd_append(&cmd, "-DHEAP_COUNTING");
+    cmd_append(&cmd, "-o", BUILD_FOLDER"main", "main.c", "game.c", "model_cache.c", "render_batch.c", VOXEL_SOURCES);
+    append_libraries(&cmd);
+
+    if (!cmd_run(&cmd)) return 1;
+
+    append_compiler(&cmd);
+    cmd_append(&cmd, "-O2");
+    cmd_append(&cmd, "-o", BUILD_FOLDER"bench_kernels", "bench_kernels.c", VOXEL_SOURCES);
+    append_libraries(&cmd);
+
+    if (!cmd_run(&cmd)) return 1;
+
+    // Headless, runs without a window
+    append_compiler(&cmd);
+    cmd_append(&cmd, "-O2");
+    cmd_append(&cmd, "-o", BUILD_FOLDER"bench_voxel", "bench_voxel.c", VOXEL_SOURCES);
+    append_libraries(&cmd);
+
+    if (!cmd_run(&cmd)) return 1;
+
+    append_compiler(&cmd);
+    cmd_append(&cmd, "-O2");
+    cmd_append(&cmd, "-o", BUILD_FOLDER"golden_voxel", "golden_voxel.c", VOXEL_SOURCES);
+    append_libraries(&cmd);
+
+    if (!cmd_run(&cmd)) return 1;
+
+    // Registry stress test, headless
+    append_compiler(&cmd);
+    cmd_append(&cmd, "-O2");
+    cmd_append(&cmd, "-o", BUILD_FOLDER"bench_entities", "bench_entities.c", "game.c", "model_cache.c", "render_batch.c");
+    append_libraries(&cmd);
+
+    if (!cmd_run(&cmd)) return 1;
+
+    // Asset cooker, writes resources/cooked/
+    append_compiler(&cmd);
+    cmd_append(&cmd, "-O2");
+    cmd_append(&cmd, "-o", BUILD_FOLDER"cook", "cook.c", VOXEL_SOURCES);
+    append_libraries(&cmd);
+
     if (!cmd_run(&cmd)) return 1;
-    
+
     return 0;
 }
@@ -0,0 +1,211 @@
+#include "render_batch.h"
+#include <raymath.h>
+#include <rlgl.h>
+#include <stdlib.h>
+
+// raylib's default shader plus a per-instance model matrix. Instance
+// transforms are affine, so their bottom row is free and carries the
+// instance color; the vertex shader reads it and restores (0, 0, 0, 1).
+static const char *instancing_vs =
+    "#version 330\n"
+    "in vec3 vertexPosition;\n"
+    "in vec2 vertexTexCoord;\n"
+    "in vec4 vertexColor;\n"
+    "in mat4 instanceTransform;\n"
+    "uniform mat4 mvp;\n"
+    "out vec2 fragTexCoord;\n"
+    "out vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    mat4 model = instanceTransform;\n"
+    "    fragColor = vertexColor*vec4(model[0][3], model[1][3], model[2][3], model[3][3]);\n"
+    "    model[0][3] = 0.0;\n"
+    "    model[1][3] = 0.0;\n"
+    "    model[2][3] = 0.0;\n"
+    "    model[3][3] = 1.0;\n"
+    "    fragTexCoord = vertexTexCoord;\n"
+    "    gl_Position = mvp*model*vec4(vertexPosition, 1.0);\n"
+    "}\n";
+
+static const char *instancing_fs =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 colDiffuse;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    finalColor = texture(texture0, fragTexCoord)*colDiffuse*fragColor;\n"
+    "}\n";
+
+static void load(RenderBatches *batches)
+{
+    batches->ready = true;
+
+    // GLSL 330 only; ES 2.0 has no core instancing
+    int version = rlGetVersion();
+    if (version != RL_OPENGL_33 && version != RL_OPENGL_43) {
+        TraceLog(LOG_WARNING, "GAME: Instanced drawing unavailable, drawing entities one by one");
+        return;
+    }
+
+    Shader shader = LoadShaderFromMemory(instancing_vs, instancing_fs);
+    if (shader.id == 0 || shader.id == rlGetShaderIdDefault()) {
+        TraceLog(LOG_WARNING, "GAME: Failed to load the instancing shader, drawing entities one by one");
+        return;
+    }
+    shader.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(shader, "instanceTransform");
+
+    batches->material = LoadMaterialDefault();
+    batches->material.shader = shader;
+
+    // Unit meshes, scaled per instance like DrawCube(), DrawSphere() and DrawPlane()
+    batches->cube = GenMeshCube(1.0f, 1.0f, 1.0f);
+    batches->sphere = GenMeshSphere(1.0f, 16, 16);
+    batches->plane = GenMeshPlane(1.0f, 1.0f, 1, 1);
+    batches->instanced = true;
+}
+
+static void list_push(InstanceList *list, Matrix transform, Color color)
+{
+    if (list->count >= list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        Matrix *transforms = realloc(list->transforms, new_capacity * sizeof(*transforms));
+        if (transforms == NULL) {
+            TraceLog(LOG_ERROR, "GAME: Out of memory for %zu instances", new_capacity);
+            return;
+        }
+        list->transforms = transforms;
+        list->capacity = new_capacity;
+    }
+
+    transform.m3 = color.r / 255.0f;
+    transform.m7 = color.g / 255.0f;
+    transform.m11 = color.b / 255.0f;
+    transform.m15 = color.a / 255.0f;
+    list->transforms[list->count++] = transform;
+}
+
+// One instanced draw per list; empty lists cost nothing
+static void draw_list(RenderBatches *batches, Mesh mesh, Material material, const InstanceList *list)
+{
+    if (list->count == 0) return;
+    DrawMeshInstanced(mesh, material, list->transforms, (int)list->count);
+    batches->draw_calls++;
+}
+
+// Outlines have no instanced equivalent yet: DrawMeshInstanced() only draws
+// triangles, and line mode over the solid meshes would show every triangle
+// edge. So each instance goes through DrawCubeWires() or DrawSphereWires()
+// like the immediate-mode path, placed by its transform; rlgl batches the
+// lines into few draw calls.
+static void draw_wires(RenderBatches *batches, BatchPrimitive primitive, const InstanceList *list)
+{
+    if (list->count == 0) return;
+
+    for (size_t i = 0; i < list->count; i++) {
+        Matrix transform = list->transforms[i];
+        Color color = {
+            (unsigned char)(transform.m3 * 255.0f + 0.5f),
+            (unsigned char)(transform.m7 * 255.0f + 0.5f),
+            (unsigned char)(transform.m11 * 255.0f + 0.5f),
+            (unsigned char)(transform.m15 * 255.0f + 0.5f),
+        };
+        transform.m3 = 0.0f;
+        transform.m7 = 0.0f;
+        transform.m11 = 0.0f;
+        transform.m15 = 1.0f;
+
+        rlPushMatrix();
+        rlMultMatrixf(MatrixToFloat(transform));
+        if (primitive == BATCH_SPHERE_WIRES) DrawSphereWires(Vector3Zero(), 1.0f, 16, 16, color);
+        else DrawCubeWires(Vector3Zero(), 1.0f, 1.0f, 1.0f, color);
+        rlPopMatrix();
+    }
+    batches->draw_calls++;
+}
+
+bool render_batches_begin(RenderBatches *batches)
+{
+    if (!batches->ready) load(batches);
+
+    for (int i = 0; i < BATCH_PRIMITIVE_COUNT; ++i) batches->primitives[i].count = 0;
+    for (size_t i = 0; i < batches->model_count; ++i) batches->models[i].count = 0;
+    batches->draw_calls = 0;
+    return batches->instanced;
+}
+
+void render_batches_add(RenderBatches *batches, BatchPrimitive primitive, Matrix transform, Color color)
+{
+    list_push(&batches->primitives[primitive], transform, color);
+}
+
+void render_batches_add_model(RenderBatches *batches, ModelHandle model, Matrix transform, Color color)
+{
+    if (model.generation == 0) return;
+
+    if (model.index >= batches->model_count) {
+        size_t count = (size_t)model.index + 1;
+        InstanceList *models = realloc(batches->models, count * sizeof(*models));
+        if (models != NULL) batches->models = models;
+        ModelHandle *handles = realloc(batches->model_handles, count * sizeof(*handles));
+        if (handles != NULL) batches->model_handles = handles;
+        if (models == NULL || handles == NULL) {
+            TraceLog(LOG_ERROR, "GAME: Out of memory for model instances");
+            return;
+        }
+        for (size_t i = batches->model_count; i < count; ++i) models[i] = (InstanceList){ 0 };
+        batches->model_count = count;
+    }
+
+    // One live model per entry, so a stale handle would only name a model
+    // that is no longer loaded
+    InstanceList *list = &batches->models[model.index];
+    if (list->count > 0 && batches->model_handles[model.index].generation != model.generation) return;
+    batches->model_handles[model.index] = model;
+    list_push(list, transform, color);
+}
+
+void render_batches_draw(RenderBatches *batches, ModelCache *models)
+{
+    if (!batches->instanced) return;
+
+    InstanceList *lists = batches->primitives;
+    draw_list(batches, batches->cube, batches->material, &lists[BATCH_CUBE]);
+    draw_list(batches, batches->sphere, batches->material, &lists[BATCH_SPHERE]);
+    draw_list(batches, batches->plane, batches->material, &lists[BATCH_PLANE]);
+
+    // After the solids, as the immediate-mode path draws them
+    draw_wires(batches, BATCH_CUBE_WIRES, &lists[BATCH_CUBE_WIRES]);
+    draw_wires(batches, BATCH_SPHERE_WIRES, &lists[BATCH_SPHERE_WIRES]);
+
+    for (size_t i = 0; i < batches->model_count; ++i) {
+        if (batches->models[i].count == 0) continue;
+        Model *model = model_cache_get(models, batches->model_handles[i]);
+        if (model == NULL) continue;
+
+        // Each mesh keeps its own material, textures and color, with the
+        // instancing shader swapped in
+        for (int mesh = 0; mesh < model->meshCount; mesh++) {
+            Material material = model->materials[model->meshMaterial[mesh]];
+            material.shader = batches->material.shader;
+            draw_list(batches, model->meshes[mesh], material, &batches->models[i]);
+        }
+    }
+}
+
+void render_batches_free(RenderBatches *batches)
+{
+    if (batches->instanced) {
+        UnloadMesh(batches->cube);
+        UnloadMesh(batches->sphere);
+        UnloadMesh(batches->plane);
+        UnloadMaterial(batches->material); // and its shader
+    }
+    for (int i = 0; i < BATCH_PRIMITIVE_COUNT; ++i) free(batches->primitives[i].transforms);
+    for (size_t i = 0; i < batches->model_count; ++i) free(batches->models[i].transforms);
+    free(batches->models);
+    free(batches->model_handles);
+    *batches = (RenderBatches){ 0 };
+}
@@ -0,0 +1,65 @@
+#ifndef RENDER_BATCH_H
+#define RENDER_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <raylib.h>
+#include "model_cache.h"
+
+typedef enum
+{
+    BATCH_CUBE,
+    BATCH_CUBE_WIRES,
+    BATCH_SPHERE,
+    BATCH_SPHERE_WIRES,
+    BATCH_PLANE,
+    BATCH_PRIMITIVE_COUNT
+} BatchPrimitive;
+
+// Instances of one mesh collected over a frame
+typedef struct
+{
+    Matrix *transforms;
+    size_t count;
+    size_t capacity;
+} InstanceList;
+
+// Entities grouped per primitive and per model over a frame, then drawn
+// with one instanced draw per primitive and per model mesh. Outlines are
+// the exception and are replayed in immediate mode. Every instance has its
+// own transform and color. Lists keep their memory between frames.
+// Needs a window; the shader and unit meshes are loaded by the first
+// render_batches_begin().
+typedef struct
+{
+    bool ready;
+    bool instanced; // false when the GL or shader lacks instancing
+    Material material; // instancing shader, default texture
+    Mesh cube;
+    Mesh sphere;
+    Mesh plane;
+    InstanceList primitives[BATCH_PRIMITIVE_COUNT];
+    InstanceList *models; // by ModelHandle index
+    ModelHandle *model_handles; // the handle each list was filled for
+    size_t model_count;
+
+    // Last frame: draw calls issued and CPU time spent building and
+    // submitting them
+    int draw_calls;
+    double submit_ms;
+} RenderBatches;
+
+// Empties the lists for a new frame. Returns false when instancing is
+// unavailable, in which case the caller draws the entities itself.
+bool render_batches_begin(RenderBatches *batches);
+
+// transform must be affine; its bottom row is replaced by the color
+void render_batches_add(RenderBatches *batches, BatchPrimitive primitive, Matrix transform, Color color);
+void render_batches_add_model(RenderBatches *batches, ModelHandle model, Matrix transform, Color color);
+
+// Issues the instanced draws, between BeginMode3D() and EndMode3D()
+void render_batches_draw(RenderBatches *batches, ModelCache *models);
+
+void render_batches_free(RenderBatches *batches);
+
+#endif // RENDER_BATCH_H
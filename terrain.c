@@ -0,0 +1,532 @@
+#include "terrain.h"
+#include "voxel_space_map.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Cooked terrain file: this header, then the texel levels, the max-height
+// levels, the palette and the two index planes at the offsets it gives,
+// each COOKED_ALIGNMENT aligned. Texel levels after the first and the
+// max-height pyramid are optional; the palette and planes are left out for
+// a map with too many colors. Stored in the host's byte order; a file from
+// a machine with the other one fails the magic check and is cooked again.
+#define COOKED_MAGIC 0x52545856u // "VXTR"
+#define COOKED_VERSION 2u
+#define COOKED_ALIGNMENT 64
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t levelCount;          // at least 1, the full-resolution texels
+    uint32_t maxHeightLevelCount; // 0 or TERRAIN_MAX_HEIGHT_LEVELS
+    int32_t paletteSize;          // -1 without palette and planes
+    uint64_t sourceHash;
+    uint64_t levelOffsets[TERRAIN_MAX_LEVELS];
+    uint64_t maxHeightOffsets[TERRAIN_MAX_HEIGHT_LEVELS];
+    uint64_t paletteOffset;       // TERRAIN_PALETTE_SIZE colors
+    uint64_t colorIndexOffset;    // size * size bytes
+    uint64_t heightOffset;        // size * size bytes
+} CookedHeader;
+
+// Terrains can be loaded on the map loader thread, so the count is atomic
+static atomic_size_t terrainAllocations = 0;
+
+// Averages 2x2 blocks of each level into the next one. All levels after
+// the first share one allocation that starts at levels[1].
+static void build_mip_chain(Terrain *terrain)
+{
+    terrain->levels[0] = terrain->texels;
+    terrain->levelCount = 1;
+
+    size_t texelCount = 0;
+    for (int level = 1; level < TERRAIN_MAX_LEVELS; level++) {
+        int size = terrain->size >> level;
+        texelCount += (size_t)size * size;
+    }
+
+    TerrainTexel *storage = (TerrainTexel *)malloc(texelCount * sizeof(TerrainTexel));
+    terrainAllocations++;
+    if (storage == NULL) {
+        TraceLog(LOG_WARNING, "TERRAIN: Out of memory for mip levels, LOD rendering will use full resolution");
+        return;
+    }
+
+    for (int level = 1; level < TERRAIN_MAX_LEVELS; level++) {
+        int srcSize = terrain->size >> (level - 1);
+        int size = srcSize >> 1;
+        const TerrainTexel *src = terrain->levels[level - 1];
+
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                TerrainTexel a = src[(2 * y) * srcSize + 2 * x];
+                TerrainTexel b = src[(2 * y) * srcSize + 2 * x + 1];
+                TerrainTexel c = src[(2 * y + 1) * srcSize + 2 * x];
+                TerrainTexel d = src[(2 * y + 1) * srcSize + 2 * x + 1];
+                storage[y * size + x] = (TerrainTexel){
+                    (uint8_t)((a.r + b.r + c.r + d.r + 2) / 4),
+                    (uint8_t)((a.g + b.g + c.g + d.g + 2) / 4),
+                    (uint8_t)((a.b + b.b + c.b + d.b + 2) / 4),
+                    (uint8_t)((a.height + b.height + c.height + d.height + 2) / 4),
+                };
+            }
+        }
+
+        terrain->levels[level] = storage;
+        terrain->levelCount++;
+        storage += (size_t)size * size;
+    }
+}
+
+// A bilinear sample at cell (x, y) also reads its right and bottom
+// neighbours, so level 0 takes the max over that 2x2 footprint and every
+// further level takes the max over 2x2 blocks of the one before.
+static void build_max_height_pyramid(Terrain *terrain)
+{
+    size_t byteCount = 0;
+    for (int level = 0; level < TERRAIN_MAX_HEIGHT_LEVELS; level++) {
+        int size = terrain->size >> level;
+        byteCount += (size_t)size * size;
+    }
+
+    uint8_t *storage = (uint8_t *)malloc(byteCount);
+    terrainAllocations++;
+    if (storage == NULL) {
+        TraceLog(LOG_WARNING, "TERRAIN: Out of memory for the max-height pyramid, empty-space skipping disabled");
+        return;
+    }
+
+    int n = terrain->size;
+    const TerrainTexel *texels = terrain->texels;
+    for (int y = 0; y < n; y++) {
+        int y1 = (y + 1) & (n - 1);
+        for (int x = 0; x < n; x++) {
+            int x1 = (x + 1) & (n - 1);
+            uint8_t h = texels[y * n + x].height;
+            if (texels[y * n + x1].height > h) h = texels[y * n + x1].height;
+            if (texels[y1 * n + x].height > h) h = texels[y1 * n + x].height;
+            if (texels[y1 * n + x1].height > h) h = texels[y1 * n + x1].height;
+            storage[y * n + x] = h;
+        }
+    }
+    terrain->maxHeights[0] = storage;
+    terrain->maxHeightLevelCount = 1;
+
+    for (int level = 1; level < TERRAIN_MAX_HEIGHT_LEVELS; level++) {
+        int srcSize = n >> (level - 1);
+        int size = srcSize >> 1;
+        const uint8_t *src = terrain->maxHeights[level - 1];
+        uint8_t *dst = storage + (size_t)srcSize * srcSize;
+
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                uint8_t h = src[(2 * y) * srcSize + 2 * x];
+                if (src[(2 * y) * srcSize + 2 * x + 1] > h) h = src[(2 * y) * srcSize + 2 * x + 1];
+                if (src[(2 * y + 1) * srcSize + 2 * x] > h) h = src[(2 * y + 1) * srcSize + 2 * x];
+                if (src[(2 * y + 1) * srcSize + 2 * x + 1] > h) h = src[(2 * y + 1) * srcSize + 2 * x + 1];
+                dst[y * size + x] = h;
+            }
+        }
+
+        terrain->maxHeights[level] = dst;
+        terrain->maxHeightLevelCount++;
+        storage = dst;
+    }
+}
+
+// Collects the distinct colors of count texels into palette, in order of
+// first appearance, and splits every texel into its palette index and its
+// height. Colors are looked up in an open-addressed table twice the
+// palette's size. Returns the palette size, -1 if the colors do not fit.
+static int index_colors(const TerrainTexel *texels, size_t count, uint8_t *colorIndices, uint8_t *heights, Color *palette)
+{
+    enum { SLOTS = 2 * TERRAIN_PALETTE_SIZE };
+    uint32_t slotColor[SLOTS];
+    int16_t slotIndex[SLOTS];
+    for (int i = 0; i < SLOTS; i++) slotIndex[i] = -1;
+
+    int paletteSize = 0;
+    for (size_t i = 0; i < count; i++) {
+        TerrainTexel texel = texels[i];
+        uint32_t color = (uint32_t)texel.r | ((uint32_t)texel.g << 8) | ((uint32_t)texel.b << 16);
+
+        uint32_t slot = (color * 0x9e3779b1u) >> 23; // top 9 bits, SLOTS == 512
+        while (slotIndex[slot] >= 0 && slotColor[slot] != color) slot = (slot + 1) & (SLOTS - 1);
+
+        if (slotIndex[slot] < 0) {
+            if (paletteSize == TERRAIN_PALETTE_SIZE) return -1;
+            slotColor[slot] = color;
+            slotIndex[slot] = (int16_t)paletteSize;
+            palette[paletteSize++] = terrain_texel_color(texel);
+        }
+        colorIndices[i] = (uint8_t)slotIndex[slot];
+        heights[i] = texel.height;
+    }
+
+    // Unused entries stay black, so any index is safe to look up
+    for (int i = paletteSize; i < TERRAIN_PALETTE_SIZE; i++) palette[i] = (Color){ 0, 0, 0, 255 };
+    return paletteSize;
+}
+
+bool terrain_build_indices(Terrain *terrain)
+{
+    if (terrain->colorIndices) return true;
+    if (terrain->paletteSize < 0 || terrain->texels == NULL) return false;
+
+    // Both planes in one allocation, starting at colorIndices
+    size_t count = (size_t)terrain->size * terrain->size;
+    uint8_t *planes = (uint8_t *)malloc(2 * count);
+    terrainAllocations++;
+    if (planes == NULL) {
+        TraceLog(LOG_WARNING, "TERRAIN: Out of memory for palette indices, palettized rendering disabled");
+        return false;
+    }
+
+    terrain->paletteSize = index_colors(terrain->texels, count, planes, planes + count, terrain->palette);
+    if (terrain->paletteSize < 0) {
+        TraceLog(LOG_INFO, "TERRAIN: More than %d colors, palettized rendering disabled", TERRAIN_PALETTE_SIZE);
+        free(planes);
+        return false;
+    }
+    terrain->colorIndices = planes;
+    terrain->heights = planes + count;
+    return true;
+}
+
+void terrain_interleave(TerrainTexel *texels, const Color *colors, const Color *heights, int count)
+{
+    for (int i = 0; i < count; i++) {
+        texels[i] = (TerrainTexel){ colors[i].r, colors[i].g, colors[i].b, heights[i].r };
+    }
+}
+
+bool terrain_load(Terrain *terrain, const char *colorPath, const char *heightPath)
+{
+    Image colorImage = LoadImage(colorPath);
+    Image heightImage = LoadImage(heightPath);
+
+    if (colorImage.data == NULL || heightImage.data == NULL) {
+        TraceLog(LOG_ERROR, "TERRAIN: Failed to load map files. Check if 'resources' directory exists in working directory.");
+        UnloadImage(colorImage);
+        UnloadImage(heightImage);
+        return false;
+    }
+
+    // The renderer wraps coordinates with '& (MAP_N - 1)', so anything else would read out of bounds
+    if (colorImage.width != MAP_N || colorImage.height != MAP_N ||
+        heightImage.width != MAP_N || heightImage.height != MAP_N) {
+        TraceLog(LOG_ERROR, "TERRAIN: Map %s is not %dx%d", colorPath, MAP_N, MAP_N);
+        UnloadImage(colorImage);
+        UnloadImage(heightImage);
+        return false;
+    }
+
+    // Decode to RGBA once and interleave; the source images are not needed afterwards
+    Color *colorMap = LoadImageColors(colorImage);
+    Color *heightMap = LoadImageColors(heightImage);
+    TerrainTexel *texels = (TerrainTexel *)malloc(MAP_N * MAP_N * sizeof(TerrainTexel));
+    terrainAllocations += 3;
+
+    if (texels) terrain_interleave(texels, colorMap, heightMap, MAP_N * MAP_N);
+
+    UnloadImageColors(colorMap);
+    UnloadImageColors(heightMap);
+    UnloadImage(colorImage);
+    UnloadImage(heightImage);
+
+    if (texels == NULL) {
+        TraceLog(LOG_ERROR, "TERRAIN: Out of memory while loading %s", colorPath);
+        return false;
+    }
+
+    terrain_unload(terrain);
+    terrain->texels = texels;
+    terrain->size = MAP_N;
+    build_mip_chain(terrain);
+    build_max_height_pyramid(terrain);
+
+    return true;
+}
+
+// Storage inside a cooked file's mapping goes away with the mapping
+static bool in_mapping(const Terrain *terrain, const void *p)
+{
+    const uint8_t *begin = (const uint8_t *)terrain->mapping;
+    return begin && (const uint8_t *)p >= begin && (const uint8_t *)p < begin + terrain->mappingSize;
+}
+
+void terrain_unload(Terrain *terrain)
+{
+    if (terrain->levelCount > 1 && !in_mapping(terrain, terrain->levels[1])) free((TerrainTexel *)terrain->levels[1]);
+    if (!in_mapping(terrain, terrain->maxHeights[0])) free((uint8_t *)terrain->maxHeights[0]);
+    if (!in_mapping(terrain, terrain->texels)) free((TerrainTexel *)terrain->texels);
+    if (!in_mapping(terrain, terrain->colorIndices)) free((uint8_t *)terrain->colorIndices);
+    if (terrain->mapping) munmap(terrain->mapping, terrain->mappingSize);
+    *terrain = (Terrain){ 0 };
+}
+
+size_t terrain_memory_bytes(const Terrain *terrain)
+{
+    size_t count = (size_t)terrain->size * terrain->size;
+    size_t bytes = terrain->mapping ? terrain->mappingSize : 0;
+    if (terrain->texels && !in_mapping(terrain, terrain->texels)) bytes += count * sizeof(TerrainTexel);
+    if (terrain->levelCount > 1 && !in_mapping(terrain, terrain->levels[1])) {
+        for (int level = 1; level < terrain->levelCount; level++) bytes += (count >> (2 * level)) * sizeof(TerrainTexel);
+    }
+    if (terrain->maxHeightLevelCount > 0 && !in_mapping(terrain, terrain->maxHeights[0])) {
+        for (int level = 0; level < terrain->maxHeightLevelCount; level++) bytes += count >> (2 * level);
+    }
+    if (terrain->colorIndices && !in_mapping(terrain, terrain->colorIndices)) bytes += 2 * count;
+    return bytes;
+}
+
+uint64_t terrain_source_hash(const char *colorPath, const char *heightPath)
+{
+    const char *paths[2] = { colorPath, heightPath };
+    uint64_t hash = 0xcbf29ce484222325ull;
+    unsigned char buffer[64 * 1024];
+
+    for (int i = 0; i < 2; i++) {
+        FILE *file = fopen(paths[i], "rb");
+        if (file == NULL) return 0;
+
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            for (size_t k = 0; k < count; k++) {
+                hash ^= buffer[k];
+                hash *= 0x100000001b3ull;
+            }
+        }
+        fclose(file);
+    }
+    return hash != 0 ? hash : 1;
+}
+
+void terrain_cooked_path(const char *colorPath, char *path, size_t pathSize)
+{
+    const char *name = strrchr(colorPath, '/');
+    name = name ? name + 1 : colorPath;
+    const char *dot = strchr(name, '.');
+    int length = dot ? (int)(dot - name) : (int)strlen(name);
+    snprintf(path, pathSize, TERRAIN_COOKED_FOLDER"%.*s.terrain", length, name);
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + COOKED_ALIGNMENT - 1) & ~(uint64_t)(COOKED_ALIGNMENT - 1);
+}
+
+// Fills in the offsets and returns the file size
+static uint64_t layout_cooked(CookedHeader *header)
+{
+    uint64_t offset = align_offset(sizeof(CookedHeader));
+    for (uint32_t level = 0; level < header->levelCount; level++) {
+        uint64_t size = header->size >> level;
+        header->levelOffsets[level] = offset;
+        offset = align_offset(offset + size * size * sizeof(TerrainTexel));
+    }
+    for (uint32_t level = 0; level < header->maxHeightLevelCount; level++) {
+        uint64_t size = header->size >> level;
+        header->maxHeightOffsets[level] = offset;
+        offset = align_offset(offset + size * size);
+    }
+
+    // Last, so loading can prefetch everything before them
+    header->paletteOffset = header->colorIndexOffset = header->heightOffset = 0;
+    if (header->paletteSize > 0) {
+        uint64_t count = (uint64_t)header->size * header->size;
+        header->paletteOffset = offset;
+        offset = align_offset(offset + TERRAIN_PALETTE_SIZE * sizeof(Color));
+        header->colorIndexOffset = offset;
+        offset = align_offset(offset + count);
+        header->heightOffset = offset;
+        offset = align_offset(offset + count);
+    }
+    return offset;
+}
+
+static bool write_at(FILE *file, uint64_t offset, const void *data, size_t size)
+{
+    return fseek(file, (long)offset, SEEK_SET) == 0 && fwrite(data, 1, size, file) == size;
+}
+
+bool terrain_cook(const Terrain *terrain, uint64_t sourceHash, bool withPyramids, const char *cookedPath)
+{
+    // Index a terrain that was not, into scratch planes
+    size_t count = (size_t)terrain->size * terrain->size;
+    const uint8_t *colorIndices = terrain->colorIndices;
+    const uint8_t *heights = terrain->heights;
+    const Color *palette = terrain->palette;
+    int paletteSize = terrain->paletteSize;
+    uint8_t *scratch = NULL;
+    Color scratchPalette[TERRAIN_PALETTE_SIZE];
+    if (colorIndices == NULL && paletteSize >= 0) {
+        scratch = (uint8_t *)malloc(2 * count);
+        terrainAllocations++;
+        if (scratch == NULL) {
+            TraceLog(LOG_WARNING, "TERRAIN: Out of memory while cooking %s", cookedPath);
+            return false;
+        }
+        paletteSize = index_colors(terrain->texels, count, scratch, scratch + count, scratchPalette);
+        colorIndices = scratch;
+        heights = scratch + count;
+        palette = scratchPalette;
+    }
+
+    CookedHeader header = {
+        .magic = COOKED_MAGIC,
+        .version = COOKED_VERSION,
+        .size = (uint32_t)terrain->size,
+        .levelCount = withPyramids ? (uint32_t)terrain->levelCount : 1,
+        .maxHeightLevelCount = withPyramids && terrain->maxHeightLevelCount == TERRAIN_MAX_HEIGHT_LEVELS ? TERRAIN_MAX_HEIGHT_LEVELS : 0,
+        .paletteSize = paletteSize > 0 ? paletteSize : -1,
+        .sourceHash = sourceHash,
+    };
+    uint64_t fileSize = layout_cooked(&header);
+
+    // Written under a temporary name and renamed, so a reader never maps a
+    // half-written file, even with several cookers running
+    mkdir(TERRAIN_COOKED_FOLDER, 0755);
+    char tempPath[512];
+    snprintf(tempPath, sizeof(tempPath), "%s.%ld.tmp", cookedPath, (long)getpid());
+    FILE *file = fopen(tempPath, "wb");
+    if (file == NULL) {
+        TraceLog(LOG_WARNING, "TERRAIN: Could not write %s", tempPath);
+        free(scratch);
+        return false;
+    }
+
+    bool written = write_at(file, 0, &header, sizeof(header));
+    for (uint32_t level = 0; written && level < header.levelCount; level++) {
+        size_t size = (size_t)terrain->size >> level;
+        written = write_at(file, header.levelOffsets[level], terrain->levels[level], size * size * sizeof(TerrainTexel));
+    }
+    for (uint32_t level = 0; written && level < header.maxHeightLevelCount; level++) {
+        size_t size = (size_t)terrain->size >> level;
+        written = write_at(file, header.maxHeightOffsets[level], terrain->maxHeights[level], size * size);
+    }
+    if (written && header.paletteSize > 0) {
+        written = write_at(file, header.paletteOffset, palette, TERRAIN_PALETTE_SIZE * sizeof(Color)) &&
+                  write_at(file, header.colorIndexOffset, colorIndices, count) &&
+                  write_at(file, header.heightOffset, heights, count);
+    }
+    free(scratch);
+    // Extend to the full size, the last section may end in alignment padding
+    if (written) written = fflush(file) == 0 && ftruncate(fileno(file), (off_t)fileSize) == 0;
+    written = fclose(file) == 0 && written;
+
+    if (!written || rename(tempPath, cookedPath) != 0) {
+        TraceLog(LOG_WARNING, "TERRAIN: Could not write %s", cookedPath);
+        remove(tempPath);
+        return false;
+    }
+    return true;
+}
+
+bool terrain_load_cooked(Terrain *terrain, const char *cookedPath, uint64_t sourceHash)
+{
+    int fd = open(cookedPath, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < sizeof(CookedHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t mappingSize = (size_t)info.st_size;
+    void *mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    // Every field is checked before use, the file may be stale or truncated
+    CookedHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    CookedHeader expected = header;
+    bool valid = header.magic == COOKED_MAGIC && header.version == COOKED_VERSION &&
+                 header.size == MAP_N && header.levelCount >= 1 && header.levelCount <= TERRAIN_MAX_LEVELS &&
+                 (header.maxHeightLevelCount == 0 || header.maxHeightLevelCount == TERRAIN_MAX_HEIGHT_LEVELS) &&
+                 header.paletteSize >= -1 && header.paletteSize <= TERRAIN_PALETTE_SIZE &&
+                 (sourceHash == 0 || header.sourceHash == sourceHash);
+    if (valid) {
+        valid = layout_cooked(&expected) <= mappingSize &&
+                memcmp(expected.levelOffsets, header.levelOffsets, sizeof(header.levelOffsets)) == 0 &&
+                memcmp(expected.maxHeightOffsets, header.maxHeightOffsets, sizeof(header.maxHeightOffsets)) == 0 &&
+                expected.paletteOffset == header.paletteOffset &&
+                expected.colorIndexOffset == header.colorIndexOffset &&
+                expected.heightOffset == header.heightOffset;
+    }
+    if (!valid) {
+        munmap(mapping, mappingSize);
+        return false;
+    }
+
+    // Fault the pages in ahead of the first frame. The index planes are
+    // only read by palettized rendering, so they are left to fault in on use.
+    posix_madvise(mapping, header.paletteSize > 0 ? header.paletteOffset : mappingSize, POSIX_MADV_WILLNEED);
+
+    terrain_unload(terrain);
+    terrain->mapping = mapping;
+    terrain->mappingSize = mappingSize;
+    terrain->size = (int)header.size;
+    terrain->texels = (const TerrainTexel *)((const uint8_t *)mapping + header.levelOffsets[0]);
+
+    if (header.levelCount > 1) {
+        for (uint32_t level = 0; level < header.levelCount; level++) {
+            terrain->levels[level] = (const TerrainTexel *)((const uint8_t *)mapping + header.levelOffsets[level]);
+        }
+        terrain->levelCount = (int)header.levelCount;
+    } else {
+        build_mip_chain(terrain);
+    }
+
+    if (header.maxHeightLevelCount > 0) {
+        for (uint32_t level = 0; level < header.maxHeightLevelCount; level++) {
+            terrain->maxHeights[level] = (const uint8_t *)mapping + header.maxHeightOffsets[level];
+        }
+        terrain->maxHeightLevelCount = (int)header.maxHeightLevelCount;
+    } else {
+        build_max_height_pyramid(terrain);
+    }
+
+    terrain->paletteSize = header.paletteSize;
+    if (header.paletteSize > 0) {
+        memcpy(terrain->palette, (const uint8_t *)mapping + header.paletteOffset, sizeof(terrain->palette));
+        terrain->colorIndices = (const uint8_t *)mapping + header.colorIndexOffset;
+        terrain->heights = (const uint8_t *)mapping + header.heightOffset;
+    }
+    return true;
+}
+
+bool terrain_load_cached(Terrain *terrain, const char *colorPath, const char *heightPath)
+{
+    char cookedPath[256];
+    terrain_cooked_path(colorPath, cookedPath, sizeof(cookedPath));
+
+    // Hashing the compressed sources is far cheaper than decoding them
+    uint64_t sourceHash = terrain_source_hash(colorPath, heightPath);
+    if (terrain_load_cooked(terrain, cookedPath, sourceHash)) return true;
+    if (sourceHash == 0) {
+        TraceLog(LOG_ERROR, "TERRAIN: Neither %s nor an up to date %s found", colorPath, cookedPath);
+        return false;
+    }
+
+    TraceLog(LOG_INFO, "TERRAIN: %s missing or stale, cooking it from %s", cookedPath, colorPath);
+    if (!terrain_load(terrain, colorPath, heightPath)) return false;
+
+    // Keep the planes the cooked file gets, like a mapped terrain would
+    terrain_build_indices(terrain);
+    terrain_cook(terrain, sourceHash, true, cookedPath);
+    return true;
+}
+
+size_t terrain_allocation_count(void)
+{
+    return terrainAllocations;
+}
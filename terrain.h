@@ -0,0 +1,114 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One map cell: the color with the height stored where alpha would be, so
+// a single 32-bit fetch returns everything a ray step needs
+typedef struct
+{
+    uint8_t r, g, b;
+    uint8_t height;
+} TerrainTexel;
+
+#define TERRAIN_PALETTE_SIZE 256
+
+// Number of mip levels kept per map, level 0 included (1024 down to 32)
+#define TERRAIN_MAX_LEVELS 6
+
+// Levels of the max-height pyramid, for blocks of 1x1 up to 64x64 texels
+#define TERRAIN_MAX_HEIGHT_LEVELS 7
+
+// Cooked terrains written on first use, one file per map pair
+#define TERRAIN_COOKED_FOLDER "resources/cooked/"
+
+// Decoded terrain for one map pair. The color and height maps are
+// interleaved into a single texel array once by terrain_load() and stay
+// resident until the terrain is unloaded or replaced, so the renderer can
+// read them every frame without touching the heap. A cooked terrain is the
+// same layout memory-mapped straight from its file.
+typedef struct
+{
+    const TerrainTexel *texels;
+    int size;
+
+    // Box-filtered mip chain built at load time. levels[0] is texels and
+    // level i is (size >> i) texels wide.
+    const TerrainTexel *levels[TERRAIN_MAX_LEVELS];
+    int levelCount;
+
+    // Max-height pyramid built at load time. maxHeights[k] has one byte per
+    // 2^k x 2^k block, holding the highest height a bilinear sample whose
+    // (x0, y0) cell lies in that block can reach.
+    const uint8_t *maxHeights[TERRAIN_MAX_HEIGHT_LEVELS];
+    int maxHeightLevelCount;
+
+    // The full-resolution texels again as two byte planes: the color as an
+    // index into palette, and the height. A height sample then reads a
+    // quarter of the bytes of a texel. Part of a cooked file, otherwise
+    // built by terrain_build_indices(). The color GIFs hold at most 256
+    // colors, so this is lossless; a map with more has no planes.
+    const uint8_t *colorIndices;
+    const uint8_t *heights;
+    Color palette[TERRAIN_PALETTE_SIZE];
+    int paletteSize; // 0 until indexed, -1 for a map with too many colors
+
+    // Read-only mapping of a cooked file, NULL for a terrain on the heap.
+    // Pyramids the file did not contain are still built on the heap.
+    void *mapping;
+    size_t mappingSize;
+} Terrain;
+
+// Map colors are opaque, so the texel's alpha slot is free for the height
+static inline Color terrain_texel_color(TerrainTexel texel)
+{
+    return (Color){ texel.r, texel.g, texel.b, 255 };
+}
+
+// Packs decoded color and height maps (height from the red channel) into texels
+void terrain_interleave(TerrainTexel *texels, const Color *colors, const Color *heights, int count);
+
+// Decodes the source images
+bool terrain_load(Terrain *terrain, const char *colorPath, const char *heightPath);
+
+// Builds the palette and index planes of a terrain that has none yet, for
+// palettized rendering. Returns whether the terrain has them; a map with
+// more than TERRAIN_PALETTE_SIZE colors is only scanned once.
+bool terrain_build_indices(Terrain *terrain);
+
+// 64-bit FNV-1a over the contents of both source images, 0 if either is missing
+uint64_t terrain_source_hash(const char *colorPath, const char *heightPath);
+
+// TERRAIN_COOKED_FOLDER followed by the color map's file name up to its
+// first dot, and ".terrain": resources/map3.color.gif gives
+// resources/cooked/map3.terrain
+void terrain_cooked_path(const char *colorPath, char *path, size_t pathSize);
+
+// Writes the terrain in the cooked format, with its palette and index
+// planes, and its mip chain and max-height pyramid if withPyramids is set. sourceHash is stored so a
+// cooked file can be checked against the images it was made from.
+bool terrain_cook(const Terrain *terrain, uint64_t sourceHash, bool withPyramids, const char *cookedPath);
+
+// Maps a cooked file. Fails without logging an error if the file is missing,
+// from another format version, or was cooked from sources whose hash is not
+// sourceHash (0 accepts any).
+bool terrain_load_cooked(Terrain *terrain, const char *cookedPath, uint64_t sourceHash);
+
+// Maps the cooked file if it is up to date with the sources. Otherwise
+// decodes and indexes the sources and cooks them for next time, so the
+// terrain has its index planes either way. Without the sources, any cooked
+// file is used.
+bool terrain_load_cached(Terrain *terrain, const char *colorPath, const char *heightPath);
+
+void terrain_unload(Terrain *terrain);
+
+// Memory the terrain holds: its heap arrays plus the whole mapping, if any
+size_t terrain_memory_bytes(const Terrain *terrain);
+
+// Total number of heap allocations made by the terrain layer so far.
+size_t terrain_allocation_count(void);
+
+#endif // TERRAIN_H
@@ -0,0 +1,343 @@
+#include "terrain_gen.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define GEN_X86 1
+    #include <immintrin.h>
+#elif defined(__aarch64__)
+    #define GEN_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#define HASH_X 0x27d4eb2du
+#define HASH_Y 0x165667b1u
+#define HASH_MIX 0x2c1b3c6du
+
+// Heights are generated one page row at a time, plus one sample on the
+// right for the slope shading of the border column
+#define ROW_SAMPLES (VOXEL_PAGE_STRIDE + 1)
+
+// Per-row constants for one octave, shared by all code paths
+typedef struct
+{
+    int cellShift;
+    uint32_t maskX;     // lattice columns - 1, so the noise repeats with the world
+    uint32_t rowTerm0;  // hash terms of the lattice rows above and below
+    uint32_t rowTerm1;
+    float sy;           // smoothed position between them
+    float invCell;
+    float amplitude;
+} Octave;
+
+static inline float smooth(float t)
+{
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// Hash of lattice point (x, row) with rowTerm = row * HASH_Y ^ seed,
+// as a value in [0, 1)
+static inline float lattice_value(uint32_t x, uint32_t rowTerm)
+{
+    uint32_t h = (x * HASH_X) ^ rowTerm;
+    h ^= h >> 15;
+    h *= HASH_MIX;
+    h ^= h >> 12;
+    return (float)(int32_t)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+static void setup_octaves(const TerrainGenerator *generator, uint32_t y, Octave *octaves)
+{
+    int worldN = VOXEL_PAGE_N << generator->shiftX;
+    int worldNY = VOXEL_PAGE_N << generator->shiftY;
+    float amplitude = 0.5f;
+
+    for (int o = 0; o < TERRAIN_GEN_OCTAVES; o++) {
+        int cellShift = 8 - o; // TERRAIN_GEN_BASE_CELL is 1 << 8
+        int cell = 1 << cellShift;
+        uint32_t maskY = (uint32_t)(worldNY >> cellShift) - 1;
+        uint32_t row = (y >> cellShift) & maskY;
+        uint32_t seed = generator->seed + (uint32_t)o * 0x9e3779b9u;
+
+        octaves[o] = (Octave){
+            .cellShift = cellShift,
+            .maskX = (uint32_t)(worldN >> cellShift) - 1,
+            .rowTerm0 = (row * HASH_Y) ^ seed,
+            .rowTerm1 = (((row + 1) & maskY) * HASH_Y) ^ seed,
+            .sy = smooth((float)(y & (cell - 1)) * (1.0f / cell)),
+            .invCell = 1.0f / cell,
+            .amplitude = amplitude,
+        };
+        amplitude *= 0.5f;
+    }
+}
+
+static inline float noise_scalar(const Octave *octaves, uint32_t x)
+{
+    float sum = 0.0f;
+    for (int o = 0; o < TERRAIN_GEN_OCTAVES; o++) {
+        const Octave *oct = &octaves[o];
+        uint32_t x0 = (x >> oct->cellShift) & oct->maskX;
+        uint32_t x1 = (x0 + 1) & oct->maskX;
+        float sx = smooth((float)(int32_t)(x & ((1u << oct->cellShift) - 1)) * oct->invCell);
+
+        float v00 = lattice_value(x0, oct->rowTerm0);
+        float v10 = lattice_value(x1, oct->rowTerm0);
+        float v01 = lattice_value(x0, oct->rowTerm1);
+        float v11 = lattice_value(x1, oct->rowTerm1);
+        float top = v00 + (v10 - v00) * sx;
+        float bottom = v01 + (v11 - v01) * sx;
+        sum += (top + (bottom - top) * oct->sy) * oct->amplitude;
+    }
+    return sum;
+}
+
+// The SIMD rows below run the same float operations in the same order as
+// noise_scalar(), lane by lane, so all paths give identical heights. Each
+// returns how many samples it did; the caller finishes the rest.
+
+static int noise_row_scalar(const Octave *octaves, uint32_t x, float *out, int count)
+{
+    for (int i = 0; i < count; i++) out[i] = noise_scalar(octaves, x + (uint32_t)i);
+    return count;
+}
+
+#if GEN_X86
+// SSE2 has no 32-bit low multiply, so it is built from two 32x32->64 ones
+static inline __m128i mullo_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 lattice_value_sse2(__m128i x, __m128i rowTerm)
+{
+    __m128i h = _mm_xor_si128(mullo_sse2(x, _mm_set1_epi32((int)HASH_X)), rowTerm);
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    h = mullo_sse2(h, _mm_set1_epi32((int)HASH_MIX));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+static int noise_row_sse2(const Octave *octaves, uint32_t x, float *out, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i xs = _mm_add_epi32(_mm_set1_epi32((int)(x + (uint32_t)i)), _mm_setr_epi32(0, 1, 2, 3));
+        __m128 sum = _mm_setzero_ps();
+
+        for (int o = 0; o < TERRAIN_GEN_OCTAVES; o++) {
+            const Octave *oct = &octaves[o];
+            __m128i mask = _mm_set1_epi32((int)oct->maskX);
+            __m128i x0 = _mm_and_si128(_mm_srli_epi32(xs, oct->cellShift), mask);
+            __m128i x1 = _mm_and_si128(_mm_add_epi32(x0, _mm_set1_epi32(1)), mask);
+            __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(xs, _mm_set1_epi32((1 << oct->cellShift) - 1))), _mm_set1_ps(oct->invCell));
+            __m128 sx = _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), t)));
+
+            __m128i row0 = _mm_set1_epi32((int)oct->rowTerm0);
+            __m128i row1 = _mm_set1_epi32((int)oct->rowTerm1);
+            __m128 v00 = lattice_value_sse2(x0, row0);
+            __m128 v10 = lattice_value_sse2(x1, row0);
+            __m128 v01 = lattice_value_sse2(x0, row1);
+            __m128 v11 = lattice_value_sse2(x1, row1);
+            __m128 top = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), sx));
+            __m128 bottom = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), sx));
+            __m128 value = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(oct->sy)));
+            sum = _mm_add_ps(sum, _mm_mul_ps(value, _mm_set1_ps(oct->amplitude)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256 lattice_value_avx2(__m256i x, __m256i rowTerm)
+{
+    __m256i h = _mm256_xor_si256(_mm256_mullo_epi32(x, _mm256_set1_epi32((int)HASH_X)), rowTerm);
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)HASH_MIX));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(h, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+}
+
+__attribute__((target("avx2")))
+static int noise_row_avx2(const Octave *octaves, uint32_t x, float *out, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i xs = _mm256_add_epi32(_mm256_set1_epi32((int)(x + (uint32_t)i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 sum = _mm256_setzero_ps();
+
+        for (int o = 0; o < TERRAIN_GEN_OCTAVES; o++) {
+            const Octave *oct = &octaves[o];
+            __m256i mask = _mm256_set1_epi32((int)oct->maskX);
+            __m256i x0 = _mm256_and_si256(_mm256_srli_epi32(xs, oct->cellShift), mask);
+            __m256i x1 = _mm256_and_si256(_mm256_add_epi32(x0, _mm256_set1_epi32(1)), mask);
+            __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(xs, _mm256_set1_epi32((1 << oct->cellShift) - 1))), _mm256_set1_ps(oct->invCell));
+            __m256 sx = _mm256_mul_ps(_mm256_mul_ps(t, t), _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), t)));
+
+            __m256i row0 = _mm256_set1_epi32((int)oct->rowTerm0);
+            __m256i row1 = _mm256_set1_epi32((int)oct->rowTerm1);
+            __m256 v00 = lattice_value_avx2(x0, row0);
+            __m256 v10 = lattice_value_avx2(x1, row0);
+            __m256 v01 = lattice_value_avx2(x0, row1);
+            __m256 v11 = lattice_value_avx2(x1, row1);
+            __m256 top = _mm256_add_ps(v00, _mm256_mul_ps(_mm256_sub_ps(v10, v00), sx));
+            __m256 bottom = _mm256_add_ps(v01, _mm256_mul_ps(_mm256_sub_ps(v11, v01), sx));
+            __m256 value = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), _mm256_set1_ps(oct->sy)));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(value, _mm256_set1_ps(oct->amplitude)));
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+    return i;
+}
+#endif // GEN_X86
+
+#if GEN_NEON
+static inline float32x4_t lattice_value_neon(uint32x4_t x, uint32x4_t rowTerm)
+{
+    uint32x4_t h = veorq_u32(vmulq_n_u32(x, HASH_X), rowTerm);
+    h = veorq_u32(h, vshrq_n_u32(h, 15));
+    h = vmulq_n_u32(h, HASH_MIX);
+    h = veorq_u32(h, vshrq_n_u32(h, 12));
+    return vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(h, 8)), 1.0f / 16777216.0f);
+}
+
+static int noise_row_neon(const Octave *octaves, uint32_t x, float *out, int count)
+{
+    static const uint32_t laneOffsets[4] = { 0, 1, 2, 3 };
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t xs = vaddq_u32(vdupq_n_u32(x + (uint32_t)i), vld1q_u32(laneOffsets));
+        float32x4_t sum = vdupq_n_f32(0.0f);
+
+        for (int o = 0; o < TERRAIN_GEN_OCTAVES; o++) {
+            const Octave *oct = &octaves[o];
+            uint32x4_t mask = vdupq_n_u32(oct->maskX);
+            uint32x4_t x0 = vandq_u32(vshlq_u32(xs, vdupq_n_s32(-oct->cellShift)), mask);
+            uint32x4_t x1 = vandq_u32(vaddq_u32(x0, vdupq_n_u32(1)), mask);
+            float32x4_t t = vmulq_n_f32(vcvtq_f32_u32(vandq_u32(xs, vdupq_n_u32((1u << oct->cellShift) - 1))), oct->invCell);
+            float32x4_t sx = vmulq_f32(vmulq_f32(t, t), vsubq_f32(vdupq_n_f32(3.0f), vmulq_n_f32(t, 2.0f)));
+
+            uint32x4_t row0 = vdupq_n_u32(oct->rowTerm0);
+            uint32x4_t row1 = vdupq_n_u32(oct->rowTerm1);
+            float32x4_t v00 = lattice_value_neon(x0, row0);
+            float32x4_t v10 = lattice_value_neon(x1, row0);
+            float32x4_t v01 = lattice_value_neon(x0, row1);
+            float32x4_t v11 = lattice_value_neon(x1, row1);
+            float32x4_t top = vaddq_f32(v00, vmulq_f32(vsubq_f32(v10, v00), sx));
+            float32x4_t bottom = vaddq_f32(v01, vmulq_f32(vsubq_f32(v11, v01), sx));
+            float32x4_t value = vaddq_f32(top, vmulq_n_f32(vsubq_f32(bottom, top), oct->sy));
+            sum = vaddq_f32(sum, vmulq_n_f32(value, oct->amplitude));
+        }
+        vst1q_f32(out + i, sum);
+    }
+    return i;
+}
+#endif // GEN_NEON
+
+static void noise_row(VoxelKernel kernel, const Octave *octaves, uint32_t x, float *out, int count)
+{
+    int done = 0;
+    switch (kernel) {
+#if GEN_X86
+        case VOXEL_KERNEL_AVX2: done = noise_row_avx2(octaves, x, out, count); break;
+        case VOXEL_KERNEL_SSE2: done = noise_row_sse2(octaves, x, out, count); break;
+#endif
+#if GEN_NEON
+        case VOXEL_KERNEL_NEON: done = noise_row_neon(octaves, x, out, count); break;
+#endif
+        default: break;
+    }
+    noise_row_scalar(octaves, x + (uint32_t)done, out + done, count - done);
+}
+
+// Noise sums cluster around 0.5; spread them over the height range with
+// low ground flattened into a sea
+static inline uint8_t shape_height(float noise)
+{
+    float h = (noise - 0.2f) * 2.0f;
+    if (h < 0.15f) h = 0.15f;
+    if (h > 1.0f) h = 1.0f;
+    return (uint8_t)(h * h * 255.0f);
+}
+
+void terrain_gen_page(const TerrainGenerator *generator, VoxelKernel kernel, int pageX, int pageY, TerrainTexel *texels)
+{
+    uint32_t worldMaskY = ((uint32_t)VOXEL_PAGE_N << generator->shiftY) - 1;
+    uint32_t x = (uint32_t)pageX * VOXEL_PAGE_N;
+    Octave octaves[TERRAIN_GEN_OCTAVES];
+    float noise[ROW_SAMPLES + 8];
+
+    for (int row = 0; row < VOXEL_PAGE_STRIDE; row++) {
+        uint32_t y = ((uint32_t)pageY * VOXEL_PAGE_N + (uint32_t)row) & worldMaskY;
+        setup_octaves(generator, y, octaves);
+
+        // Samples past the world's right edge wrap through the lattice masks
+        noise_row(kernel, octaves, x, noise, ROW_SAMPLES);
+
+        TerrainTexel *out = texels + row * VOXEL_PAGE_STRIDE;
+        uint8_t next = shape_height(noise[0]);
+        for (int i = 0; i < VOXEL_PAGE_STRIDE; i++) {
+            uint8_t height = next;
+            next = shape_height(noise[i + 1]);
+
+            // Lit from the west: slopes rising to the east are darker
+            TerrainTexel color = generator->palette[height];
+            int shade = 256 - ((int)next - (int)height) * 12;
+            if (shade < 128) shade = 128;
+            if (shade > 384) shade = 384;
+            int r = color.r * shade >> 8;
+            int g = color.g * shade >> 8;
+            int b = color.b * shade >> 8;
+            out[i] = (TerrainTexel){ (uint8_t)(r > 255 ? 255 : r), (uint8_t)(g > 255 ? 255 : g), (uint8_t)(b > 255 ? 255 : b), height };
+        }
+    }
+}
+
+static bool fill_generated_page(void *userData, int pageX, int pageY, TerrainTexel *texels)
+{
+    const TerrainGenerator *generator = (const TerrainGenerator *)userData;
+    terrain_gen_page(generator, generator->kernel, pageX, pageY, texels);
+    return true;
+}
+
+TileSource terrain_gen_source(TerrainGenerator *generator)
+{
+    return (TileSource){ fill_generated_page, generator, generator->shiftX, generator->shiftY };
+}
+
+void terrain_gen_init(TerrainGenerator *generator, uint32_t seed, int shiftX, int shiftY, VoxelKernel kernel)
+{
+    *generator = (TerrainGenerator){ .seed = seed, .shiftX = shiftX, .shiftY = shiftY };
+
+    // The fixed-point kernel has no generator of its own
+    generator->kernel = voxel_kernel_resolve(kernel == VOXEL_KERNEL_FIXED ? VOXEL_KERNEL_AUTO : kernel);
+
+    // Sea, beach, grass, forest, rock and snow, blended between bands
+    static const struct { int height; uint8_t r, g, b; } bands[] = {
+        { 0,   28,  64,  120 },
+        { 6,   40,  90,  150 },
+        { 10,  194, 178, 128 },
+        { 24,  96,  150, 64 },
+        { 90,  48,  100, 40 },
+        { 150, 110, 100, 90 },
+        { 210, 150, 145, 140 },
+        { 235, 240, 240, 245 },
+        { 255, 255, 255, 255 },
+    };
+    int bandCount = (int)(sizeof(bands) / sizeof(bands[0]));
+
+    for (int h = 0; h < 256; h++) {
+        int band = 0;
+        while (band + 2 < bandCount && bands[band + 1].height <= h) band++;
+        int span = bands[band + 1].height - bands[band].height;
+        int t = span > 0 ? (h - bands[band].height) * 256 / span : 0;
+        if (t > 256) t = 256;
+        generator->palette[h] = (TerrainTexel){
+            (uint8_t)(bands[band].r + ((bands[band + 1].r - bands[band].r) * t >> 8)),
+            (uint8_t)(bands[band].g + ((bands[band + 1].g - bands[band].g) * t >> 8)),
+            (uint8_t)(bands[band].b + ((bands[band + 1].b - bands[band].b) * t >> 8)),
+            (uint8_t)h,
+        };
+    }
+}
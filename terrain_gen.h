@@ -0,0 +1,38 @@
+#ifndef TERRAIN_GEN_H
+#define TERRAIN_GEN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "terrain.h"
+#include "tile_cache.h"
+#include "voxel_kernels.h"
+
+// Octaves of value noise summed per height, from cells of
+// TERRAIN_GEN_BASE_CELL texels down to TERRAIN_GEN_BASE_CELL >> (octaves - 1)
+#define TERRAIN_GEN_OCTAVES 6
+#define TERRAIN_GEN_BASE_CELL 256
+
+// Procedural terrain: fractal value noise heights, colored by height band
+// and shaded by slope. Any texel can be generated on its own, so pages are
+// made independently and their borders match their neighbours. The noise
+// repeats with the world size, so the world wraps without a seam.
+typedef struct
+{
+    uint32_t seed;
+    int shiftX; // the world is (1 << shiftX) x (1 << shiftY) pages
+    int shiftY;
+    VoxelKernel kernel; // resolved; scalar, SSE2, AVX2 or NEON
+    TerrainTexel palette[256]; // ground color by height
+} TerrainGenerator;
+
+// kernel picks the SIMD code path like the column kernels do; every path
+// produces the same texels
+void terrain_gen_init(TerrainGenerator *generator, uint32_t seed, int shiftX, int shiftY, VoxelKernel kernel);
+
+// Writes VOXEL_PAGE_TEXELS texels, border included, with a given code path
+void terrain_gen_page(const TerrainGenerator *generator, VoxelKernel kernel, int pageX, int pageY, TerrainTexel *texels);
+
+// The generator as a tile cache source
+TileSource terrain_gen_source(TerrainGenerator *generator);
+
+#endif // TERRAIN_GEN_H
@@ -0,0 +1,496 @@
+#include "tile_cache.h"
+#include "worker_pool.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Lifetime of a slot. Only the render thread moves slots out of
+// SLOT_LOADED and SLOT_FAILED, and only loader threads out of SLOT_QUEUED
+// and SLOT_LOADING.
+enum
+{
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_LOADING,
+    SLOT_LOADED,   // filled, not in the page table yet
+    SLOT_FAILED,
+    SLOT_RESIDENT, // in the page table
+};
+
+// Lifetime of a map in a TileMapSource, changed under its mutex
+enum
+{
+    MAP_UNLOADED,
+    MAP_LOADING,  // by one loader thread, outside the mutex
+    MAP_RESIDENT,
+    MAP_FAILED,   // never tried again
+};
+
+typedef struct TileRequest
+{
+    int page;
+    float distance;
+} TileRequest;
+
+// Squares of side VOXEL_PAGE_N a view of VOXEL_MAX_DEPTH can touch, per position
+#define REQUESTS_PER_POSITION ((2 * VOXEL_MAX_DEPTH / VOXEL_PAGE_N + 2) * (2 * VOXEL_MAX_DEPTH / VOXEL_PAGE_N + 2))
+
+static TerrainTexel *slot_texels(const TileCache *cache, int slot)
+{
+    return cache->slotTexels + (size_t)slot * VOXEL_PAGE_TEXELS;
+}
+
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void *loader_main(void *arg)
+{
+    TileCache *cache = (TileCache *)arg;
+    int pagesX = 1 << cache->source.shiftX;
+
+    pthread_mutex_lock(&cache->mutex);
+    for (;;) {
+        while (!cache->quit && cache->queueCount == 0) {
+            pthread_cond_wait(&cache->wake, &cache->mutex);
+        }
+        if (cache->quit) break;
+
+        int slot = cache->queue[cache->queueHead];
+        cache->queueHead = (cache->queueHead + 1) % cache->slotCount;
+        cache->queueCount--;
+        int page = cache->slotPage[slot];
+        atomic_store(&cache->slotState[slot], SLOT_LOADING);
+        pthread_mutex_unlock(&cache->mutex);
+
+        long long start = now_ns();
+        bool filled = cache->source.fill(cache->source.userData, page & (pagesX - 1), page >> cache->source.shiftX, slot_texels(cache, slot));
+        atomic_fetch_add(&cache->fillNanos, now_ns() - start);
+        atomic_fetch_add(&cache->filledPages, 1);
+        atomic_store_explicit(&cache->slotState[slot], filled ? SLOT_LOADED : SLOT_FAILED, memory_order_release);
+
+        pthread_mutex_lock(&cache->mutex);
+        // tile_cache_flush() waits on the same condition
+        pthread_cond_broadcast(&cache->wake);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    return NULL;
+}
+
+bool tile_cache_init(TileCache *cache, TileSource source, size_t budgetBytes, int threadCount)
+{
+    *cache = (TileCache){ 0 };
+    cache->source = source;
+    cache->pageCount = 1 << (source.shiftX + source.shiftY);
+    size_t pageBudget = budgetBytes > source.budgetBytes ? budgetBytes - source.budgetBytes : 0;
+    cache->slotCount = (int)(pageBudget / (VOXEL_PAGE_TEXELS * sizeof(TerrainTexel)));
+    if (cache->slotCount < 1) cache->slotCount = 1;
+    cache->requestCapacity = 2 * REQUESTS_PER_POSITION;
+
+    cache->table = (const TerrainTexel **)malloc(cache->pageCount * sizeof(TerrainTexel *));
+    cache->placeholder = (TerrainTexel *)malloc(VOXEL_PAGE_TEXELS * sizeof(TerrainTexel));
+    cache->pageSlot = (int *)malloc(cache->pageCount * sizeof(int));
+    cache->pageWantedAt = (uint64_t *)calloc(cache->pageCount, sizeof(uint64_t));
+    cache->slotTexels = (TerrainTexel *)malloc((size_t)cache->slotCount * VOXEL_PAGE_TEXELS * sizeof(TerrainTexel));
+    cache->slotPage = (int *)malloc(cache->slotCount * sizeof(int));
+    cache->slotWantedAt = (uint64_t *)calloc(cache->slotCount, sizeof(uint64_t));
+    cache->slotState = (atomic_int *)malloc(cache->slotCount * sizeof(atomic_int));
+    cache->requests = (TileRequest *)malloc(cache->requestCapacity * sizeof(TileRequest));
+    cache->queue = (int *)malloc(cache->slotCount * sizeof(int));
+
+    if (!cache->table || !cache->placeholder || !cache->pageSlot || !cache->pageWantedAt ||
+        !cache->slotTexels || !cache->slotPage || !cache->slotWantedAt || !cache->slotState ||
+        !cache->requests || !cache->queue) {
+        TraceLog(LOG_ERROR, "TILES: Out of memory for a %zu byte tile cache", budgetBytes);
+        tile_cache_free(cache);
+        return false;
+    }
+
+    // Flat ground until the real page arrives
+    for (int i = 0; i < VOXEL_PAGE_TEXELS; i++) cache->placeholder[i] = (TerrainTexel){ 60, 60, 60, 0 };
+    for (int page = 0; page < cache->pageCount; page++) {
+        cache->table[page] = cache->placeholder;
+        cache->pageSlot[page] = -1;
+    }
+    for (int slot = 0; slot < cache->slotCount; slot++) {
+        cache->slotPage[slot] = -1;
+        atomic_init(&cache->slotState[slot], SLOT_FREE);
+    }
+    cache->pages = (VoxelPageTable){ cache->table, source.shiftX, source.shiftY };
+
+    if (threadCount <= 0) threadCount = worker_pool_core_count();
+    cache->threads = (pthread_t *)malloc(threadCount * sizeof(pthread_t));
+    if (!cache->threads) {
+        tile_cache_free(cache);
+        return false;
+    }
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->wake, NULL);
+
+    for (int i = 0; i < threadCount; i++) {
+        if (pthread_create(&cache->threads[i], NULL, loader_main, cache) != 0) break;
+        cache->threadCount++;
+    }
+    if (cache->threadCount == 0) {
+        TraceLog(LOG_ERROR, "TILES: Failed to start any loader thread");
+        tile_cache_free(cache);
+        return false;
+    }
+    return true;
+}
+
+void tile_cache_free(TileCache *cache)
+{
+    if (cache->threadCount > 0) {
+        pthread_mutex_lock(&cache->mutex);
+        cache->quit = true;
+        pthread_cond_broadcast(&cache->wake);
+        pthread_mutex_unlock(&cache->mutex);
+        for (int i = 0; i < cache->threadCount; i++) pthread_join(cache->threads[i], NULL);
+        pthread_cond_destroy(&cache->wake);
+        pthread_mutex_destroy(&cache->mutex);
+    }
+
+    free(cache->threads);
+    free(cache->table);
+    free(cache->placeholder);
+    free(cache->pageSlot);
+    free(cache->pageWantedAt);
+    free(cache->slotTexels);
+    free(cache->slotPage);
+    free(cache->slotWantedAt);
+    free(cache->slotState);
+    free(cache->requests);
+    free(cache->queue);
+    *cache = (TileCache){ 0 };
+}
+
+// Points the table at pages the loader threads have finished
+static void publish_loaded(TileCache *cache)
+{
+    for (int slot = 0; slot < cache->slotCount; slot++) {
+        int state = atomic_load_explicit(&cache->slotState[slot], memory_order_acquire);
+        int page = cache->slotPage[slot];
+
+        if (state == SLOT_LOADED) {
+            cache->table[page] = slot_texels(cache, slot);
+            atomic_store(&cache->slotState[slot], SLOT_RESIDENT);
+            cache->loadedPages++;
+        } else if (state == SLOT_FAILED) {
+            // Keeps the placeholder, and is not asked for again
+            TraceLog(LOG_WARNING, "TILES: Could not load page %d", page);
+            cache->pageSlot[page] = -2;
+            cache->slotPage[slot] = -1;
+            atomic_store(&cache->slotState[slot], SLOT_FREE);
+        }
+    }
+}
+
+// Adds the pages within radius of center, by distance from center plus bias
+static void add_requests(TileCache *cache, int *count, Vector2 center, float radius, float bias)
+{
+    int maskX = (1 << cache->source.shiftX) - 1;
+    int maskY = (1 << cache->source.shiftY) - 1;
+    int firstX = (int)floorf((center.x - radius) / VOXEL_PAGE_N);
+    int lastX = (int)floorf((center.x + radius) / VOXEL_PAGE_N);
+    int firstY = (int)floorf((center.y - radius) / VOXEL_PAGE_N);
+    int lastY = (int)floorf((center.y + radius) / VOXEL_PAGE_N);
+
+    for (int y = firstY; y <= lastY; y++) {
+        for (int x = firstX; x <= lastX; x++) {
+            // Distance from the center to the nearest point of the page
+            float nearX = fmaxf((float)x * VOXEL_PAGE_N, fminf(center.x, (float)(x + 1) * VOXEL_PAGE_N));
+            float nearY = fmaxf((float)y * VOXEL_PAGE_N, fminf(center.y, (float)(y + 1) * VOXEL_PAGE_N));
+            float distance = sqrtf((nearX - center.x) * (nearX - center.x) + (nearY - center.y) * (nearY - center.y));
+            if (distance > radius || *count >= cache->requestCapacity) continue;
+
+            // Small worlds wrap into the same page more than once
+            int page = ((y & maskY) << cache->source.shiftX) | (x & maskX);
+            if (cache->pageWantedAt[page] == cache->updateCount) continue;
+            cache->pageWantedAt[page] = cache->updateCount;
+
+            cache->requests[(*count)++] = (TileRequest){ page, distance + bias };
+        }
+    }
+}
+
+static int compare_requests(const void *a, const void *b)
+{
+    float x = ((const TileRequest *)a)->distance;
+    float y = ((const TileRequest *)b)->distance;
+    return (x > y) - (x < y);
+}
+
+// Least recently wanted slot that is free or holds a page nobody wants
+// this update, -1 if every slot is in use
+static int find_victim(const TileCache *cache)
+{
+    int victim = -1;
+    for (int slot = 0; slot < cache->slotCount; slot++) {
+        int state = atomic_load(&cache->slotState[slot]);
+        if (state == SLOT_FREE) return slot;
+        if (state != SLOT_RESIDENT || cache->slotWantedAt[slot] == cache->updateCount) continue;
+        if (victim < 0 || cache->slotWantedAt[slot] < cache->slotWantedAt[victim]) victim = slot;
+    }
+    return victim;
+}
+
+void tile_cache_update(TileCache *cache, Vector2 position, Vector2 ahead, float viewDistance)
+{
+    if (viewDistance > VOXEL_MAX_DEPTH) viewDistance = VOXEL_MAX_DEPTH;
+    cache->updateCount++;
+    publish_loaded(cache);
+
+    // The current view first, then the view ahead
+    int count = 0;
+    add_requests(cache, &count, position, viewDistance, 0.0f);
+    add_requests(cache, &count, ahead, viewDistance, viewDistance);
+    qsort(cache->requests, count, sizeof(TileRequest), compare_requests);
+
+    int queued = 0;
+    cache->missingPages = 0;
+
+    for (int i = 0; i < count; i++) {
+        int page = cache->requests[i].page;
+        int slot = cache->pageSlot[page];
+        if (slot == -2) continue;
+
+        if (slot >= 0) {
+            cache->slotWantedAt[slot] = cache->updateCount;
+            if (atomic_load(&cache->slotState[slot]) != SLOT_RESIDENT) cache->missingPages++;
+            continue;
+        }
+
+        cache->missingPages++;
+        slot = find_victim(cache);
+        if (slot < 0) continue; // over budget, the nearer pages have the slots
+
+        int oldPage = cache->slotPage[slot];
+        if (oldPage >= 0) {
+            cache->table[oldPage] = cache->placeholder;
+            cache->pageSlot[oldPage] = -1;
+            cache->evictedPages++;
+        }
+
+        cache->slotPage[slot] = page;
+        cache->slotWantedAt[slot] = cache->updateCount;
+        cache->pageSlot[page] = slot;
+        atomic_store(&cache->slotState[slot], SLOT_QUEUED);
+
+        if (queued == 0) pthread_mutex_lock(&cache->mutex);
+        cache->queue[(cache->queueHead + cache->queueCount) % cache->slotCount] = slot;
+        cache->queueCount++;
+        queued++;
+    }
+
+    if (queued > 0) {
+        pthread_cond_broadcast(&cache->wake);
+        pthread_mutex_unlock(&cache->mutex);
+    }
+}
+
+void tile_cache_flush(TileCache *cache)
+{
+    pthread_mutex_lock(&cache->mutex);
+    for (;;) {
+        bool busy = cache->queueCount > 0;
+        for (int slot = 0; slot < cache->slotCount && !busy; slot++) {
+            busy = atomic_load(&cache->slotState[slot]) == SLOT_LOADING;
+        }
+        if (!busy) break;
+        pthread_cond_wait(&cache->wake, &cache->mutex);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    publish_loaded(cache);
+}
+
+TileCacheStats tile_cache_stats(const TileCache *cache)
+{
+    TileCacheStats stats = {
+        .missingPages = cache->missingPages,
+        .loadedPages = cache->loadedPages,
+        .evictedPages = cache->evictedPages,
+        .budgetBytes = (size_t)cache->slotCount * VOXEL_PAGE_TEXELS * sizeof(TerrainTexel) + cache->source.budgetBytes,
+    };
+    if (cache->source.residentBytes) stats.sourceBytes = cache->source.residentBytes(cache->source.userData);
+    long long fillNanos = atomic_load(&cache->fillNanos);
+    if (fillNanos > 0) {
+        stats.pagesPerSecond = atomic_load(&cache->filledPages) * 1e9 / fillNanos * cache->threadCount;
+    }
+    for (int slot = 0; slot < cache->slotCount; slot++) {
+        int state = atomic_load(&cache->slotState[slot]);
+        if (state == SLOT_RESIDENT) stats.residentPages++;
+        else if (state != SLOT_FREE) stats.pendingPages++;
+    }
+    return stats;
+}
+
+// Map holding world texel (x, y), wrapped
+static int map_at(const TileMapSource *source, int x, int y)
+{
+    int mapX = (x / MAP_N) & ((1 << source->shiftX) - 1);
+    int mapY = (y / MAP_N) & ((1 << source->shiftY) - 1);
+    return ((mapY << source->shiftX) | mapX) % source->mapCount;
+}
+
+// Unloads least recently used maps that no fill is reading until the
+// resident ones fit the budget. Called with the mutex held, which is
+// dropped around each unload.
+static void evict_maps(TileMapSource *source)
+{
+    while (source->residentBytes > source->budgetBytes) {
+        int victim = -1;
+        for (int map = 0; map < source->mapCount; map++) {
+            if (source->mapStates[map] != MAP_RESIDENT || source->mapUsers[map] > 0) continue;
+            if (victim < 0 || source->mapUsedAt[map] < source->mapUsedAt[victim]) victim = map;
+        }
+        if (victim < 0) return; // every resident map is being read
+
+        Terrain terrain = source->terrains[victim];
+        source->terrains[victim] = (Terrain){ 0 };
+        source->mapStates[victim] = MAP_UNLOADED;
+        source->residentBytes -= terrain_memory_bytes(&terrain);
+        source->evictedMaps++;
+
+        pthread_mutex_unlock(&source->mutex);
+        terrain_unload(&terrain);
+        pthread_mutex_lock(&source->mutex);
+    }
+}
+
+// Loads the map if needed and keeps it resident until release_map(). NULL
+// if it cannot be loaded.
+static const Terrain *acquire_map(TileMapSource *source, int map)
+{
+    pthread_mutex_lock(&source->mutex);
+    while (source->mapStates[map] == MAP_LOADING) pthread_cond_wait(&source->mapLoaded, &source->mutex);
+
+    bool loadedNow = false;
+    if (source->mapStates[map] == MAP_UNLOADED) {
+        // Loaded unlocked, so fills reading other maps carry on meanwhile
+        source->mapStates[map] = MAP_LOADING;
+        pthread_mutex_unlock(&source->mutex);
+
+        Terrain loaded = { 0 };
+        bool ok = terrain_load_cached(&loaded, source->maps[map].colorMap, source->maps[map].heightMap);
+        if (!ok) TraceLog(LOG_WARNING, "TILES: Could not load map %d, its pages stay flat", map);
+
+        pthread_mutex_lock(&source->mutex);
+        source->terrains[map] = loaded;
+        source->mapStates[map] = ok ? MAP_RESIDENT : MAP_FAILED;
+        if (ok) source->residentBytes += terrain_memory_bytes(&loaded);
+        pthread_cond_broadcast(&source->mapLoaded);
+        loadedNow = ok;
+    }
+
+    const Terrain *terrain = NULL;
+    if (source->mapStates[map] == MAP_RESIDENT) {
+        terrain = &source->terrains[map];
+        source->mapUsers[map]++;
+        source->mapUsedAt[map] = ++source->useCount;
+    }
+    if (loadedNow) evict_maps(source);
+    pthread_mutex_unlock(&source->mutex);
+    return terrain;
+}
+
+// Maps the budget could not evict while they were read go once unused
+static void release_map(TileMapSource *source, int map)
+{
+    pthread_mutex_lock(&source->mutex);
+    source->mapUsers[map]--;
+    if (source->mapUsers[map] == 0) evict_maps(source);
+    pthread_mutex_unlock(&source->mutex);
+}
+
+static bool fill_map_page(void *userData, int pageX, int pageY, TerrainTexel *texels)
+{
+    TileMapSource *source = (TileMapSource *)userData;
+    int x = pageX * VOXEL_PAGE_N;
+    int y = pageY * VOXEL_PAGE_N;
+    int right = (x + VOXEL_PAGE_N) & ((MAP_N << source->shiftX) - 1);
+    int below = (y + VOXEL_PAGE_N) & ((MAP_N << source->shiftY) - 1);
+
+    // A page never straddles two maps, but its border repeats the
+    // neighbours to the right and below, which may be in other maps
+    int maps[4] = { map_at(source, x, y), map_at(source, right, y), map_at(source, x, below), map_at(source, right, below) };
+    const Terrain *terrains[4];
+    int acquired = 0;
+    while (acquired < 4 && (terrains[acquired] = acquire_map(source, maps[acquired])) != NULL) acquired++;
+
+    if (acquired == 4) {
+        int localX = x & (MAP_N - 1);
+        int localY = y & (MAP_N - 1);
+        int rightX = right & (MAP_N - 1);
+        int belowY = below & (MAP_N - 1);
+        for (int row = 0; row < VOXEL_PAGE_N; row++) {
+            memcpy(texels + row * VOXEL_PAGE_STRIDE, terrains[0]->texels + (localY + row) * MAP_N + localX, VOXEL_PAGE_N * sizeof(TerrainTexel));
+        }
+        for (int i = 0; i < VOXEL_PAGE_N; i++) {
+            texels[i * VOXEL_PAGE_STRIDE + VOXEL_PAGE_N] = terrains[1]->texels[(localY + i) * MAP_N + rightX];
+            texels[VOXEL_PAGE_N * VOXEL_PAGE_STRIDE + i] = terrains[2]->texels[belowY * MAP_N + localX + i];
+        }
+        texels[VOXEL_PAGE_N * VOXEL_PAGE_STRIDE + VOXEL_PAGE_N] = terrains[3]->texels[belowY * MAP_N + rightX];
+    }
+
+    for (int i = 0; i < acquired; i++) release_map(source, maps[i]);
+    return acquired == 4;
+}
+
+static size_t map_source_bytes(void *userData)
+{
+    TileMapSource *source = (TileMapSource *)userData;
+    pthread_mutex_lock(&source->mutex);
+    size_t bytes = source->residentBytes;
+    pthread_mutex_unlock(&source->mutex);
+    return bytes;
+}
+
+bool tile_map_source_init(TileMapSource *source, const map_t *maps, int mapCount, int shiftX, int shiftY, size_t budgetBytes, TileSource *tiles)
+{
+    *source = (TileMapSource){
+        .maps = maps,
+        .mapCount = mapCount,
+        .shiftX = shiftX,
+        .shiftY = shiftY,
+        .terrains = (Terrain *)calloc(mapCount, sizeof(Terrain)),
+        .mapStates = (int *)calloc(mapCount, sizeof(int)), // MAP_UNLOADED
+        .mapUsers = (int *)calloc(mapCount, sizeof(int)),
+        .mapUsedAt = (uint64_t *)calloc(mapCount, sizeof(uint64_t)),
+        .budgetBytes = budgetBytes,
+    };
+    if (!source->terrains || !source->mapStates || !source->mapUsers || !source->mapUsedAt) {
+        tile_map_source_free(source);
+        return false;
+    }
+    pthread_mutex_init(&source->mutex, NULL);
+    pthread_cond_init(&source->mapLoaded, NULL);
+
+    // MAP_N / VOXEL_PAGE_N pages per map each way
+    int pageShift = 0;
+    while ((VOXEL_PAGE_N << pageShift) < MAP_N) pageShift++;
+    *tiles = (TileSource){ fill_map_page, source, shiftX + pageShift, shiftY + pageShift, budgetBytes, map_source_bytes };
+    return true;
+}
+
+void tile_map_source_free(TileMapSource *source)
+{
+    if (source->terrains && source->mapStates && source->mapUsers && source->mapUsedAt) {
+        for (int map = 0; map < source->mapCount; map++) {
+            if (source->mapStates[map] == MAP_RESIDENT) terrain_unload(&source->terrains[map]);
+        }
+        pthread_cond_destroy(&source->mapLoaded);
+        pthread_mutex_destroy(&source->mutex);
+    }
+    free(source->terrains);
+    free(source->mapStates);
+    free(source->mapUsers);
+    free(source->mapUsedAt);
+    *source = (TileMapSource){ 0 };
+}
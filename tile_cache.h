@@ -0,0 +1,143 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <pthread.h>
+#include <raylib.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "terrain.h"
+#include "voxel_kernels.h"
+#include "voxel_space_map.h"
+
+// Writes page (pageX, pageY) of a world into texels: VOXEL_PAGE_TEXELS of
+// them, border included. Runs on the cache's loader threads, several pages
+// at a time. Returns false if the page cannot be made.
+typedef bool (*TileFillFn)(void *userData, int pageX, int pageY, TerrainTexel *texels);
+
+// Bytes a source holds itself at the moment
+typedef size_t (*TileBytesFn)(void *userData);
+
+// Where a world's pages come from
+typedef struct
+{
+    TileFillFn fill;
+    void *userData;
+    int shiftX; // the world is (1 << shiftX) x (1 << shiftY) pages
+    int shiftY;
+
+    // What the source may hold itself, taken out of the cache's budget,
+    // and how much it holds now. 0 and NULL for a source holding nothing.
+    size_t budgetBytes;
+    TileBytesFn residentBytes;
+} TileSource;
+
+typedef struct
+{
+    int residentPages;
+    int pendingPages; // queued for or being filled by a loader thread
+    int missingPages; // wanted by the last update but not resident yet
+    long long loadedPages;
+    long long evictedPages;
+    size_t budgetBytes; // page storage, allocated up front, plus the source's share
+    size_t sourceBytes; // held by the source now
+    double pagesPerSecond; // fill throughput of all loader threads when busy
+} TileCacheStats;
+
+// Pages of a world streamed into a fixed number of slots. Loader threads
+// fill slots in the background; tile_cache_update(), on the render thread
+// between frames, decides which pages should be resident, evicts the least
+// recently wanted ones to make room and points the page table at pages
+// once they are complete. The table never references a slot that is being
+// filled, so the renderer can sample through it without locking.
+typedef struct
+{
+    TileSource source;
+    VoxelPageTable pages;        // what the renderer samples through
+    const TerrainTexel **table;  // the same entries, writable
+    TerrainTexel *placeholder;   // flat page shown where nothing is loaded yet
+    int pageCount;
+    int *pageSlot;               // slot holding each page, -1 if none, -2 if it failed
+    uint64_t *pageWantedAt;      // update that last asked for each page
+
+    int slotCount;
+    TerrainTexel *slotTexels;    // slotCount pages of VOXEL_PAGE_TEXELS
+    int *slotPage;               // page in each slot, -1 if free
+    uint64_t *slotWantedAt;      // update that last asked for the slot's page
+    atomic_int *slotState;
+
+    // Scratch list of the pages one update wants, sorted by distance
+    struct TileRequest *requests;
+    int requestCapacity;
+
+    pthread_t *threads;
+    int threadCount;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    bool quit;
+    int *queue; // ring buffer of slots waiting to be filled
+    int queueHead;
+    int queueCount;
+
+    uint64_t updateCount;
+    atomic_llong fillNanos; // time loader threads spent in source.fill
+    atomic_llong filledPages;
+    long long loadedPages;
+    long long evictedPages;
+    int missingPages;
+} TileCache;
+
+// budgetBytes bounds the page storage, which is all allocated here, and
+// the source's own memory: the pages get what source.budgetBytes leaves.
+// threadCount <= 0 uses one loader thread per core.
+bool tile_cache_init(TileCache *cache, TileSource source, size_t budgetBytes, int threadCount);
+
+// Stops the loader threads and frees everything
+void tile_cache_free(TileCache *cache);
+
+// Once per frame, before rendering. Publishes the pages loaded since the
+// last call, then wants every page within viewDistance of position,
+// nearest first, followed by those within viewDistance of ahead (where the
+// camera is expected to be soon), so pages along the direction of travel
+// are fetched before the camera gets there. Positions are in texels.
+void tile_cache_update(TileCache *cache, Vector2 position, Vector2 ahead, float viewDistance);
+
+// Blocks until every queued page has been filled, then publishes them
+void tile_cache_flush(TileCache *cache);
+
+TileCacheStats tile_cache_stats(const TileCache *cache);
+
+// Source stitching map pairs into a world of (1 << shiftX) x (1 << shiftY)
+// maps, taking them in order and starting over after the last one. Each
+// map is loaded with terrain_load_cached() when one of its pages is
+// needed, memory-mapped when cooked. The loader thread that first needs a
+// map loads it without holding the lock; others wanting the same map wait
+// for it, and a map that fails to load is not tried again.
+//
+// Resident maps, about 9 MB each, count against budgetBytes: past it, the
+// least recently used maps no page fill is reading are unloaded. Maps in
+// use are never unloaded, so fills in progress can briefly go over.
+typedef struct
+{
+    const map_t *maps;
+    int mapCount;
+    int shiftX;
+    int shiftY;
+    Terrain *terrains; // one per map, loaded on demand
+    int *mapStates;
+    int *mapUsers;         // page fills reading each map
+    uint64_t *mapUsedAt;   // useCount when each map was last acquired
+    uint64_t useCount;
+    size_t budgetBytes;
+    size_t residentBytes;  // terrain_memory_bytes() of the resident maps
+    long long evictedMaps;
+    pthread_mutex_t mutex;
+    pthread_cond_t mapLoaded; // a map finished loading or failed
+} TileMapSource;
+
+bool tile_map_source_init(TileMapSource *source, const map_t *maps, int mapCount, int shiftX, int shiftY, size_t budgetBytes, TileSource *tiles);
+
+void tile_map_source_free(TileMapSource *source);
+
+#endif // TILE_CACHE_H
@@ -0,0 +1,1259 @@
+#include "voxel_kernels.h"
+#include "voxel_space_map.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define VOXEL_X86 1
+    #include <immintrin.h>
+#elif defined(__aarch64__)
+    #define VOXEL_NEON 1
+    #include <arm_neon.h>
+#endif
+
+// Writes rows [startY, endY) of a column. In the column-major layout the
+// run is contiguous; in the row-major one every pixel is a row apart.
+static inline void fill_column(const VoxelFrame *frame, int column, int startY, int endY, Color color)
+{
+    Color *target = frame->target;
+    if (!target) return;
+
+    if (frame->columnWrites && endY > startY) frame->columnWrites[column] += endY - startY;
+
+    if (frame->columnMajor) {
+        Color *run = target + (size_t)column * RENDER_HEIGHT;
+        for (int y = startY; y < endY; y++) run[y] = color;
+    } else {
+        for (int y = startY; y < endY; y++) target[y * RENDER_WIDTH + column] = color;
+    }
+}
+
+// Blends a texel towards the fog color with one multiply per channel pair
+static inline Color fog_blend(const VoxelFogEntry *fog, Color pixel)
+{
+    uint32_t p;
+    memcpy(&p, &pixel, sizeof(p));
+
+    uint32_t rb = ((p & 0x00FF00FF) * fog->weight + fog->fogRB + 0x00800080) >> 8;
+    uint32_t ga = ((p >> 8) & 0x00FF00FF) * fog->weight + fog->fogGA + 0x00800080;
+    p = (rb & 0x00FF00FF) | (ga & 0xFF00FF00);
+
+    memcpy(&pixel, &p, sizeof(p));
+    return pixel;
+}
+
+// Shades the terrain texel hit at depth z and fills the newly visible span of the column
+static inline void draw_span(const VoxelFrame *frame, int column, int z, Color pixel, int projHeight, float maxHeight, float lean)
+{
+    Color scaledPixel = fog_blend(&frame->fogTable[z], pixel);
+
+    int startY = (int)(projHeight + lean);
+    int endY = (int)(maxHeight + lean);
+
+    if (startY < 0) startY = 0;
+    if (endY > RENDER_HEIGHT) endY = RENDER_HEIGHT;
+
+    fill_column(frame, column, startY, endY, scaledPixel);
+}
+
+// Fills whatever draw_span() left untouched in a column with the sky color:
+// the rows above the final occlusion line, and with a negative lean the rows
+// the first span could not reach at the bottom. Together with the spans this
+// writes every pixel of the column exactly once.
+static inline void finish_column(const VoxelFrame *frame, int column, float maxHeight, float lean)
+{
+    int topEnd = (int)(maxHeight + lean);
+    if (topEnd > RENDER_HEIGHT) topEnd = RENDER_HEIGHT;
+    fill_column(frame, column, 0, topEnd, frame->sky);
+
+    int bottomStart = (int)(RENDER_HEIGHT + lean);
+    if (bottomStart < 0) bottomStart = 0;
+    if (bottomStart < topEnd) bottomStart = topEnd;
+    fill_column(frame, column, bottomStart, RENDER_HEIGHT, frame->sky);
+}
+
+static inline float column_lean(const VoxelFrame *frame, int column)
+{
+    return (frame->tilt * (column * frame->invRenderWidth - 0.5f) + 0.5f) * RENDER_HEIGHT / 6.0f;
+}
+
+// Continuous distance used for projection to eliminate Z-judder.
+// We subtract the fractional progress into the current grid cell.
+static inline float continuous_z(const VoxelFrame *frame, int z)
+{
+    float continuousZ = (float)z - frame->depthOffset;
+    if (continuousZ < 0.1f) continuousZ = 0.1f;
+    return continuousZ;
+}
+
+// Bilinear height at (x, y) on a map level 'size' texels wide. Also returns
+// the index of the (x0, y0) texel, which provides the color.
+static inline float sample_height(const TerrainTexel *texels, int size, float x, float y, int *cell)
+{
+    float floorX = floorf(x);
+    float floorY = floorf(y);
+    float fx = x - floorX;
+    float fy = y - floorY;
+
+    int x0 = ((int)floorX) & (size - 1);
+    int y0 = ((int)floorY) & (size - 1);
+    int x1 = (x0 + 1) & (size - 1);
+    int y1 = (y0 + 1) & (size - 1);
+
+    float h00 = texels[y0 * size + x0].height;
+    float h10 = texels[y0 * size + x1].height;
+    float h01 = texels[y1 * size + x0].height;
+    float h11 = texels[y1 * size + x1].height;
+
+    *cell = y0 * size + x0;
+
+    // Bilinear blend
+    return h00 * (1.0f - fx) * (1.0f - fy) +
+           h10 * fx * (1.0f - fy) +
+           h01 * (1.0f - fx) * fy +
+           h11 * fx * fy;
+}
+
+// Screen row of terrain height h at depth z, clamped to the render target.
+// Never increases as h grows.
+static inline int project_height(const VoxelFrame *frame, float h, int z)
+{
+    int projHeight = (int)((frame->camHeight - h) / continuous_z(frame, z) * SCALE_FACTOR + frame->horizon);
+    if (projHeight < 0) projHeight = 0;
+    if (projHeight >= RENDER_HEIGHT) projHeight = RENDER_HEIGHT - 1;
+    return projHeight;
+}
+
+static inline void count_steps(const VoxelFrame *frame, long long steps)
+{
+    if (frame->stats) atomic_fetch_add_explicit(&frame->stats->raySteps, steps, memory_order_relaxed);
+}
+
+static void march_scalar(const VoxelFrame *frame, int begin, int end)
+{
+    const TerrainTexel *texels = frame->texels;
+    long long steps = 0;
+
+    for (int i = begin; i < end; i++) {
+        float deltaX = (frame->plx + (frame->prx - frame->plx) * i * frame->invRenderWidth) * frame->invZfar;
+        float deltaY = (frame->ply + (frame->pry - frame->ply) * i * frame->invRenderWidth) * frame->invZfar;
+
+        float rx = frame->startRX + deltaX * frame->initialStep;
+        float ry = frame->startRY + deltaY * frame->initialStep;
+
+        float maxHeight = (float)RENDER_HEIGHT;
+        float lean = column_lean(frame, i);
+
+        for (int z = 1; z < frame->zfarInt; z++) {
+            rx += deltaX;
+            ry += deltaY;
+
+            if (texels) {
+                steps++;
+
+                int cell;
+                float h = sample_height(texels, MAP_N, rx, ry, &cell);
+                int projHeight = project_height(frame, h, z);
+
+                if (projHeight < maxHeight) {
+                    // Still sample color from nearest to keep it fast
+                    draw_span(frame, i, z, terrain_texel_color(texels[cell]), projHeight, maxHeight, lean);
+                    maxHeight = (float)projHeight;
+
+                    // The column is fully occluded, nothing further can show
+                    if (maxHeight <= 0.0f) break;
+                }
+            }
+        }
+
+        finish_column(frame, i, maxHeight, lean);
+    }
+
+    count_steps(frame, steps);
+}
+
+// sample_height() over a plane of heights
+static inline float sample_height_plane(const uint8_t *heights, float x, float y, int *cell)
+{
+    float floorX = floorf(x);
+    float floorY = floorf(y);
+    float fx = x - floorX;
+    float fy = y - floorY;
+
+    int x0 = ((int)floorX) & (MAP_N - 1);
+    int y0 = ((int)floorY) & (MAP_N - 1);
+    int x1 = (x0 + 1) & (MAP_N - 1);
+    int y1 = (y0 + 1) & (MAP_N - 1);
+
+    float h00 = heights[y0 * MAP_N + x0];
+    float h10 = heights[y0 * MAP_N + x1];
+    float h01 = heights[y1 * MAP_N + x0];
+    float h11 = heights[y1 * MAP_N + x1];
+
+    *cell = y0 * MAP_N + x0;
+
+    return h00 * (1.0f - fx) * (1.0f - fy) +
+           h10 * fx * (1.0f - fy) +
+           h01 * (1.0f - fx) * fy +
+           h11 * fx * fy;
+}
+
+void voxel_march_palette(const VoxelFrame *frame, int begin, int end)
+{
+    const uint8_t *heights = frame->heights;
+    const uint8_t *colorIndices = frame->colorIndices;
+    long long steps = 0;
+
+    for (int i = begin; i < end; i++) {
+        float deltaX = (frame->plx + (frame->prx - frame->plx) * i * frame->invRenderWidth) * frame->invZfar;
+        float deltaY = (frame->ply + (frame->pry - frame->ply) * i * frame->invRenderWidth) * frame->invZfar;
+
+        float rx = frame->startRX + deltaX * frame->initialStep;
+        float ry = frame->startRY + deltaY * frame->initialStep;
+
+        float maxHeight = (float)RENDER_HEIGHT;
+        float lean = column_lean(frame, i);
+
+        for (int z = 1; z < frame->zfarInt; z++) {
+            rx += deltaX;
+            ry += deltaY;
+            steps++;
+
+            int cell;
+            float h = sample_height_plane(heights, rx, ry, &cell);
+            int projHeight = project_height(frame, h, z);
+
+            if (projHeight < maxHeight) {
+                const Color *palette = frame->fogPalettes + frame->fogTable[z].weight * TERRAIN_PALETTE_SIZE;
+
+                int startY = (int)(projHeight + lean);
+                int endY = (int)(maxHeight + lean);
+                if (startY < 0) startY = 0;
+                if (endY > RENDER_HEIGHT) endY = RENDER_HEIGHT;
+                fill_column(frame, i, startY, endY, palette[colorIndices[cell]]);
+
+                maxHeight = (float)projHeight;
+                if (maxHeight <= 0.0f) break;
+            }
+        }
+
+        finish_column(frame, i, maxHeight, lean);
+    }
+
+    count_steps(frame, steps);
+}
+
+// Bilinear height at 16.16 position (x, y) as 16.16, using two lerps with
+// 16-bit weights. Also returns the (x0, y0) texel index for the color.
+static inline int32_t sample_height_fixed(const TerrainTexel *texels, uint32_t x, uint32_t y, int *cell)
+{
+    int x0 = (x >> 16) & (MAP_N - 1);
+    int y0 = (y >> 16) & (MAP_N - 1);
+    int x1 = (x0 + 1) & (MAP_N - 1);
+    int y1 = (y0 + 1) & (MAP_N - 1);
+    int32_t fx = x & 0xFFFF;
+    int32_t fy = y & 0xFFFF;
+
+    int32_t h00 = texels[y0 * MAP_N + x0].height;
+    int32_t h10 = texels[y0 * MAP_N + x1].height;
+    int32_t h01 = texels[y1 * MAP_N + x0].height;
+    int32_t h11 = texels[y1 * MAP_N + x1].height;
+    int32_t top = (h00 << 16) + (h10 - h00) * fx;
+    int32_t bottom = (h01 << 16) + (h11 - h01) * fx;
+
+    *cell = y0 * MAP_N + x0;
+    return top + (int32_t)(((int64_t)(bottom - top) * fy) >> 16);
+}
+
+// project_height() with 16.16 camera height, horizon and terrain height,
+// multiplying by the depth's entry of the reciprocal table
+static inline int project_height_fixed(int32_t invZ, int64_t camHeight, int64_t horizon, int32_t h)
+{
+    int64_t row = (((camHeight - h) * invZ) >> 16) + horizon;
+    int projHeight = (int)(row >> 16);
+    if (projHeight < 0) projHeight = 0;
+    if (projHeight >= RENDER_HEIGHT) projHeight = RENDER_HEIGHT - 1;
+    return projHeight;
+}
+
+// Fixed-point version of march_scalar(). Rays step in float exactly as in
+// march_scalar() so both pick the same cells: a 16.16 step drifts from the
+// float one and flips the color cell wherever rays run along texel edges.
+// Each position is scaled to 16.16 exactly, then bilinear weights are 16-bit
+// fractions and projection multiplies by the per-depth reciprocal in
+// frame->invZTable instead of dividing. frame->startRX and startRY are in
+// the map, so positions stay well inside the 16.16 range.
+static void march_fixed(const VoxelFrame *frame, int begin, int end)
+{
+    const TerrainTexel *texels = frame->texels;
+    if (!texels || !frame->invZTable) {
+        march_scalar(frame, begin, end);
+        return;
+    }
+
+    const int32_t *invZ = frame->invZTable;
+    int64_t camHeight = (int64_t)(frame->camHeight * 65536.0f);
+    int64_t horizon = (int64_t)(frame->horizon * 65536.0f);
+    long long steps = 0;
+
+    for (int i = begin; i < end; i++) {
+        float deltaX = (frame->plx + (frame->prx - frame->plx) * i * frame->invRenderWidth) * frame->invZfar;
+        float deltaY = (frame->ply + (frame->pry - frame->ply) * i * frame->invRenderWidth) * frame->invZfar;
+
+        float rx = frame->startRX + deltaX * frame->initialStep;
+        float ry = frame->startRY + deltaY * frame->initialStep;
+
+        int maxHeight = RENDER_HEIGHT;
+        float lean = column_lean(frame, i);
+
+        for (int z = 1; z < frame->zfarInt; z++) {
+            rx += deltaX;
+            ry += deltaY;
+            steps++;
+
+            // Scaling by 2^16 is exact, so the cell is floorf() of the float position
+            int cell;
+            uint32_t x = (uint32_t)(int32_t)floorf(rx * 65536.0f);
+            uint32_t y = (uint32_t)(int32_t)floorf(ry * 65536.0f);
+            int32_t h = sample_height_fixed(texels, x, y, &cell);
+            int projHeight = project_height_fixed(invZ[z], camHeight, horizon, h);
+
+            if (projHeight < maxHeight) {
+                draw_span(frame, i, z, terrain_texel_color(texels[cell]), projHeight, (float)maxHeight, lean);
+                maxHeight = projHeight;
+
+                if (maxHeight <= 0) break;
+            }
+        }
+
+        finish_column(frame, i, (float)maxHeight, lean);
+    }
+
+    count_steps(frame, steps);
+}
+
+// The packet kernels below evaluate the exact same float expressions as
+// march_scalar(), in the same order, one column per lane. The projection
+// is done in double like the scalar code (SCALE_FACTOR is a double) so
+// that every lane truncates to the same row. Spans are still filled per
+// lane since each column writes a different run of rows. A packet stops
+// early once every lane's occlusion line has reached the top of the
+// screen, as nothing more can be drawn in those columns.
+
+#define PACKET_MAX_LANES 8
+
+#if VOXEL_X86
+
+// Bilinear heights at eight positions. The height sits in the top byte of
+// each texel; the gathered (x0, y0) texels are returned for their color.
+__attribute__((target("avx2")))
+static inline __m256 sample_height_avx2(const int *texels, __m256 rx, __m256 ry, __m256i *texel00)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i wrap = _mm256_set1_epi32(MAP_N - 1);
+    const __m256i mapN = _mm256_set1_epi32(MAP_N);
+
+    __m256 floorX = _mm256_floor_ps(rx);
+    __m256 floorY = _mm256_floor_ps(ry);
+    __m256 fx = _mm256_sub_ps(rx, floorX);
+    __m256 fy = _mm256_sub_ps(ry, floorY);
+
+    __m256i x0 = _mm256_and_si256(_mm256_cvttps_epi32(floorX), wrap);
+    __m256i y0 = _mm256_and_si256(_mm256_cvttps_epi32(floorY), wrap);
+    __m256i x1 = _mm256_and_si256(_mm256_add_epi32(x0, _mm256_set1_epi32(1)), wrap);
+    __m256i y1 = _mm256_and_si256(_mm256_add_epi32(y0, _mm256_set1_epi32(1)), wrap);
+    __m256i row0 = _mm256_mullo_epi32(y0, mapN);
+    __m256i row1 = _mm256_mullo_epi32(y1, mapN);
+    __m256i offset00 = _mm256_add_epi32(row0, x0);
+
+    *texel00 = _mm256_i32gather_epi32(texels, offset00, 4);
+    __m256 h00 = _mm256_cvtepi32_ps(_mm256_srli_epi32(*texel00, 24));
+    __m256 h10 = _mm256_cvtepi32_ps(_mm256_srli_epi32(_mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x1), 4), 24));
+    __m256 h01 = _mm256_cvtepi32_ps(_mm256_srli_epi32(_mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x0), 4), 24));
+    __m256 h11 = _mm256_cvtepi32_ps(_mm256_srli_epi32(_mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x1), 4), 24));
+
+    __m256 ifx = _mm256_sub_ps(one, fx);
+    __m256 ify = _mm256_sub_ps(one, fy);
+    __m256 h = _mm256_mul_ps(_mm256_mul_ps(h00, ifx), ify);
+    h = _mm256_add_ps(h, _mm256_mul_ps(_mm256_mul_ps(h10, fx), ify));
+    h = _mm256_add_ps(h, _mm256_mul_ps(_mm256_mul_ps(h01, ifx), fy));
+    h = _mm256_add_ps(h, _mm256_mul_ps(_mm256_mul_ps(h11, fx), fy));
+    return h;
+}
+
+// project_height() for eight heights at depth z
+__attribute__((target("avx2")))
+static inline __m256i project_height_avx2(const VoxelFrame *frame, __m256 h, int z)
+{
+    const __m256 camHeight = _mm256_set1_ps(frame->camHeight);
+    const __m256d scale = _mm256_set1_pd(SCALE_FACTOR);
+    const __m256d horizon = _mm256_set1_pd((double)frame->horizon);
+
+    __m256 ratio = _mm256_div_ps(_mm256_sub_ps(camHeight, h), _mm256_set1_ps(continuous_z(frame, z)));
+    __m256d projLo = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(ratio)), scale), horizon);
+    __m256d projHi = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(ratio, 1)), scale), horizon);
+    __m256i proj = _mm256_set_m128i(_mm256_cvttpd_epi32(projHi), _mm256_cvttpd_epi32(projLo));
+    return _mm256_min_epi32(_mm256_max_epi32(proj, _mm256_setzero_si256()), _mm256_set1_epi32(RENDER_HEIGHT - 1));
+}
+
+__attribute__((target("avx2")))
+static long long march_packet_avx2(const VoxelFrame *frame, int first)
+{
+    const int *texels = (const int *)frame->texels;
+
+    __m256 columns = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(first), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 deltaX = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(frame->plx), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(frame->prx - frame->plx), columns), _mm256_set1_ps(frame->invRenderWidth))), _mm256_set1_ps(frame->invZfar));
+    __m256 deltaY = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(frame->ply), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(frame->pry - frame->ply), columns), _mm256_set1_ps(frame->invRenderWidth))), _mm256_set1_ps(frame->invZfar));
+
+    __m256 rx = _mm256_add_ps(_mm256_set1_ps(frame->startRX), _mm256_mul_ps(deltaX, _mm256_set1_ps(frame->initialStep)));
+    __m256 ry = _mm256_add_ps(_mm256_set1_ps(frame->startRY), _mm256_mul_ps(deltaY, _mm256_set1_ps(frame->initialStep)));
+
+    float lean[PACKET_MAX_LANES];
+    for (int lane = 0; lane < 8; lane++) lean[lane] = column_lean(frame, first + lane);
+
+    const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+
+    __m256 maxHeight = _mm256_set1_ps((float)RENDER_HEIGHT);
+    int z = 1;
+
+    for (; z < frame->zfarInt; z++) {
+        rx = _mm256_add_ps(rx, deltaX);
+        ry = _mm256_add_ps(ry, deltaY);
+
+        __m256i texel00;
+        __m256 h = sample_height_avx2(texels, rx, ry, &texel00);
+        __m256i proj = project_height_avx2(frame, h, z);
+
+        __m256 projF = _mm256_cvtepi32_ps(proj);
+        __m256 visible = _mm256_cmp_ps(projF, maxHeight, _CMP_LT_OQ);
+        int visibleMask = _mm256_movemask_ps(visible);
+
+        if (visibleMask) {
+            int pixels[PACKET_MAX_LANES];
+            int rows[PACKET_MAX_LANES];
+            float limits[PACKET_MAX_LANES];
+            _mm256_storeu_si256((__m256i *)pixels, _mm256_or_si256(texel00, opaque));
+            _mm256_storeu_si256((__m256i *)rows, proj);
+            _mm256_storeu_ps(limits, maxHeight);
+
+            for (int lane = 0; lane < 8; lane++) {
+                if (!(visibleMask & (1 << lane))) continue;
+                Color pixel;
+                memcpy(&pixel, &pixels[lane], sizeof(pixel));
+                draw_span(frame, first + lane, z, pixel, rows[lane], limits[lane], lean[lane]);
+            }
+
+            maxHeight = _mm256_blendv_ps(maxHeight, projF, visible);
+            if (_mm256_movemask_ps(_mm256_cmp_ps(maxHeight, _mm256_setzero_ps(), _CMP_GT_OQ)) == 0) break;
+        }
+    }
+
+    float limits[PACKET_MAX_LANES];
+    _mm256_storeu_ps(limits, maxHeight);
+    for (int lane = 0; lane < 8; lane++) finish_column(frame, first + lane, limits[lane], lean[lane]);
+
+    // Iterations run, the one that broke out included
+    return (long long)(z < frame->zfarInt ? z : frame->zfarInt - 1) * 8;
+}
+
+__attribute__((target("avx2")))
+static void march_avx2(const VoxelFrame *frame, int begin, int end)
+{
+    if (!frame->texels) {
+        march_scalar(frame, begin, end);
+        return;
+    }
+
+    long long steps = 0;
+    int i = begin;
+    for (; i + 8 <= end; i += 8) steps += march_packet_avx2(frame, i);
+    count_steps(frame, steps);
+    march_scalar(frame, i, end);
+}
+
+// Bilinear heights at four positions, and the wrapped (x0, y0) cells
+static inline __m128 sample_height_sse2(const TerrainTexel *texels, __m128 rx, __m128 ry, int x0[4], int y0[4])
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i wrap = _mm_set1_epi32(MAP_N - 1);
+
+    // floor: truncate, then step down where truncation rounded up
+    __m128i truncX = _mm_cvttps_epi32(rx);
+    __m128i truncY = _mm_cvttps_epi32(ry);
+    __m128 aboveX = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncX), rx);
+    __m128 aboveY = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncY), ry);
+    __m128i floorXi = _mm_add_epi32(truncX, _mm_castps_si128(aboveX));
+    __m128i floorYi = _mm_add_epi32(truncY, _mm_castps_si128(aboveY));
+    __m128 fx = _mm_sub_ps(rx, _mm_cvtepi32_ps(floorXi));
+    __m128 fy = _mm_sub_ps(ry, _mm_cvtepi32_ps(floorYi));
+
+    int x1[4], y1[4];
+    _mm_storeu_si128((__m128i *)x0, _mm_and_si128(floorXi, wrap));
+    _mm_storeu_si128((__m128i *)y0, _mm_and_si128(floorYi, wrap));
+    _mm_storeu_si128((__m128i *)x1, _mm_and_si128(_mm_add_epi32(floorXi, _mm_set1_epi32(1)), wrap));
+    _mm_storeu_si128((__m128i *)y1, _mm_and_si128(_mm_add_epi32(floorYi, _mm_set1_epi32(1)), wrap));
+
+    __m128 h00 = _mm_setr_ps(texels[y0[0] * MAP_N + x0[0]].height, texels[y0[1] * MAP_N + x0[1]].height, texels[y0[2] * MAP_N + x0[2]].height, texels[y0[3] * MAP_N + x0[3]].height);
+    __m128 h10 = _mm_setr_ps(texels[y0[0] * MAP_N + x1[0]].height, texels[y0[1] * MAP_N + x1[1]].height, texels[y0[2] * MAP_N + x1[2]].height, texels[y0[3] * MAP_N + x1[3]].height);
+    __m128 h01 = _mm_setr_ps(texels[y1[0] * MAP_N + x0[0]].height, texels[y1[1] * MAP_N + x0[1]].height, texels[y1[2] * MAP_N + x0[2]].height, texels[y1[3] * MAP_N + x0[3]].height);
+    __m128 h11 = _mm_setr_ps(texels[y1[0] * MAP_N + x1[0]].height, texels[y1[1] * MAP_N + x1[1]].height, texels[y1[2] * MAP_N + x1[2]].height, texels[y1[3] * MAP_N + x1[3]].height);
+
+    __m128 ifx = _mm_sub_ps(one, fx);
+    __m128 ify = _mm_sub_ps(one, fy);
+    __m128 h = _mm_mul_ps(_mm_mul_ps(h00, ifx), ify);
+    h = _mm_add_ps(h, _mm_mul_ps(_mm_mul_ps(h10, fx), ify));
+    h = _mm_add_ps(h, _mm_mul_ps(_mm_mul_ps(h01, ifx), fy));
+    h = _mm_add_ps(h, _mm_mul_ps(_mm_mul_ps(h11, fx), fy));
+    return h;
+}
+
+// project_height() for four heights at depth z
+static inline __m128i project_height_sse2(const VoxelFrame *frame, __m128 h, int z)
+{
+    const __m128 camHeight = _mm_set1_ps(frame->camHeight);
+    const __m128d scale = _mm_set1_pd(SCALE_FACTOR);
+    const __m128d horizon = _mm_set1_pd((double)frame->horizon);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bottom = _mm_set1_epi32(RENDER_HEIGHT - 1);
+
+    __m128 ratio = _mm_div_ps(_mm_sub_ps(camHeight, h), _mm_set1_ps(continuous_z(frame, z)));
+    __m128d projLo = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(ratio), scale), horizon);
+    __m128d projHi = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(ratio, ratio)), scale), horizon);
+    __m128i proj = _mm_unpacklo_epi64(_mm_cvttpd_epi32(projLo), _mm_cvttpd_epi32(projHi));
+    proj = _mm_andnot_si128(_mm_cmplt_epi32(proj, zero), proj);
+    __m128i tooLow = _mm_cmpgt_epi32(proj, bottom);
+    proj = _mm_or_si128(_mm_andnot_si128(tooLow, proj), _mm_and_si128(tooLow, bottom));
+    return proj;
+}
+
+// SSE2 has no gathers, floor or 32-bit min/max, so those are emulated
+static long long march_packet_sse2(const VoxelFrame *frame, int first)
+{
+    const TerrainTexel *texels = frame->texels;
+
+    __m128 columns = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(first), _mm_setr_epi32(0, 1, 2, 3)));
+    __m128 deltaX = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(frame->plx), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(frame->prx - frame->plx), columns), _mm_set1_ps(frame->invRenderWidth))), _mm_set1_ps(frame->invZfar));
+    __m128 deltaY = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(frame->ply), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(frame->pry - frame->ply), columns), _mm_set1_ps(frame->invRenderWidth))), _mm_set1_ps(frame->invZfar));
+
+    __m128 rx = _mm_add_ps(_mm_set1_ps(frame->startRX), _mm_mul_ps(deltaX, _mm_set1_ps(frame->initialStep)));
+    __m128 ry = _mm_add_ps(_mm_set1_ps(frame->startRY), _mm_mul_ps(deltaY, _mm_set1_ps(frame->initialStep)));
+
+    float lean[PACKET_MAX_LANES];
+    for (int lane = 0; lane < 4; lane++) lean[lane] = column_lean(frame, first + lane);
+
+    __m128 maxHeight = _mm_set1_ps((float)RENDER_HEIGHT);
+    int z = 1;
+
+    for (; z < frame->zfarInt; z++) {
+        rx = _mm_add_ps(rx, deltaX);
+        ry = _mm_add_ps(ry, deltaY);
+
+        int x0[4], y0[4];
+        __m128 h = sample_height_sse2(texels, rx, ry, x0, y0);
+        __m128i proj = project_height_sse2(frame, h, z);
+
+        __m128 projF = _mm_cvtepi32_ps(proj);
+        __m128 visible = _mm_cmplt_ps(projF, maxHeight);
+        int visibleMask = _mm_movemask_ps(visible);
+
+        if (visibleMask) {
+            int rows[4];
+            float limits[4];
+            _mm_storeu_si128((__m128i *)rows, proj);
+            _mm_storeu_ps(limits, maxHeight);
+
+            for (int lane = 0; lane < 4; lane++) {
+                if (!(visibleMask & (1 << lane))) continue;
+                draw_span(frame, first + lane, z, terrain_texel_color(texels[MAP_N * y0[lane] + x0[lane]]), rows[lane], limits[lane], lean[lane]);
+            }
+
+            maxHeight = _mm_or_ps(_mm_andnot_ps(visible, maxHeight), _mm_and_ps(visible, projF));
+            if (_mm_movemask_ps(_mm_cmpgt_ps(maxHeight, _mm_setzero_ps())) == 0) break;
+        }
+    }
+
+    float limits[PACKET_MAX_LANES];
+    _mm_storeu_ps(limits, maxHeight);
+    for (int lane = 0; lane < 4; lane++) finish_column(frame, first + lane, limits[lane], lean[lane]);
+
+    // Iterations run, the one that broke out included
+    return (long long)(z < frame->zfarInt ? z : frame->zfarInt - 1) * 4;
+}
+
+static void march_sse2(const VoxelFrame *frame, int begin, int end)
+{
+    if (!frame->texels) {
+        march_scalar(frame, begin, end);
+        return;
+    }
+
+    long long steps = 0;
+    int i = begin;
+    for (; i + 4 <= end; i += 4) steps += march_packet_sse2(frame, i);
+    count_steps(frame, steps);
+    march_scalar(frame, i, end);
+}
+
+__attribute__((target("avx2")))
+static int bilinear_avx2(const TerrainTexel *texels, const float *x, const float *y, float *heights, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i texel00;
+        _mm256_storeu_ps(heights + i, sample_height_avx2((const int *)texels, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), &texel00));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int project_avx2(const VoxelFrame *frame, const float *heights, int z, int *rows, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i *)(rows + i), project_height_avx2(frame, _mm256_loadu_ps(heights + i), z));
+    }
+    return i;
+}
+
+static int bilinear_sse2(const TerrainTexel *texels, const float *x, const float *y, float *heights, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int x0[4], y0[4];
+        _mm_storeu_ps(heights + i, sample_height_sse2(texels, _mm_loadu_ps(x + i), _mm_loadu_ps(y + i), x0, y0));
+    }
+    return i;
+}
+
+static int project_sse2(const VoxelFrame *frame, const float *heights, int z, int *rows, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i *)(rows + i), project_height_sse2(frame, _mm_loadu_ps(heights + i), z));
+    }
+    return i;
+}
+
+#endif // VOXEL_X86
+
+#if VOXEL_NEON
+
+// Bilinear heights at four positions, and the wrapped (x0, y0) cells
+static inline float32x4_t sample_height_neon(const TerrainTexel *texels, float32x4_t rx, float32x4_t ry, int32_t x0[4], int32_t y0[4])
+{
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const int32x4_t wrap = vdupq_n_s32(MAP_N - 1);
+
+    float32x4_t floorX = vrndmq_f32(rx);
+    float32x4_t floorY = vrndmq_f32(ry);
+    float32x4_t fx = vsubq_f32(rx, floorX);
+    float32x4_t fy = vsubq_f32(ry, floorY);
+
+    int32x4_t floorXi = vcvtq_s32_f32(floorX);
+    int32x4_t floorYi = vcvtq_s32_f32(floorY);
+    int32_t x1[4], y1[4];
+    vst1q_s32(x0, vandq_s32(floorXi, wrap));
+    vst1q_s32(y0, vandq_s32(floorYi, wrap));
+    vst1q_s32(x1, vandq_s32(vaddq_s32(floorXi, vdupq_n_s32(1)), wrap));
+    vst1q_s32(y1, vandq_s32(vaddq_s32(floorYi, vdupq_n_s32(1)), wrap));
+
+    float heights[4][4];
+    for (int lane = 0; lane < 4; lane++) {
+        heights[0][lane] = texels[y0[lane] * MAP_N + x0[lane]].height;
+        heights[1][lane] = texels[y0[lane] * MAP_N + x1[lane]].height;
+        heights[2][lane] = texels[y1[lane] * MAP_N + x0[lane]].height;
+        heights[3][lane] = texels[y1[lane] * MAP_N + x1[lane]].height;
+    }
+
+    float32x4_t ifx = vsubq_f32(one, fx);
+    float32x4_t ify = vsubq_f32(one, fy);
+    float32x4_t h = vmulq_f32(vmulq_f32(vld1q_f32(heights[0]), ifx), ify);
+    h = vaddq_f32(h, vmulq_f32(vmulq_f32(vld1q_f32(heights[1]), fx), ify));
+    h = vaddq_f32(h, vmulq_f32(vmulq_f32(vld1q_f32(heights[2]), ifx), fy));
+    h = vaddq_f32(h, vmulq_f32(vmulq_f32(vld1q_f32(heights[3]), fx), fy));
+    return h;
+}
+
+// project_height() for four heights at depth z
+static inline int32x4_t project_height_neon(const VoxelFrame *frame, float32x4_t h, int z)
+{
+    const float32x4_t camHeight = vdupq_n_f32(frame->camHeight);
+    const float64x2_t scale = vdupq_n_f64(SCALE_FACTOR);
+    const float64x2_t horizon = vdupq_n_f64((double)frame->horizon);
+
+    float32x4_t ratio = vdivq_f32(vsubq_f32(camHeight, h), vdupq_n_f32(continuous_z(frame, z)));
+    float64x2_t projLo = vaddq_f64(vmulq_f64(vcvt_f64_f32(vget_low_f32(ratio)), scale), horizon);
+    float64x2_t projHi = vaddq_f64(vmulq_f64(vcvt_high_f64_f32(ratio), scale), horizon);
+    int32x4_t proj = vcombine_s32(vmovn_s64(vcvtq_s64_f64(projLo)), vmovn_s64(vcvtq_s64_f64(projHi)));
+    proj = vminq_s32(vmaxq_s32(proj, vdupq_n_s32(0)), vdupq_n_s32(RENDER_HEIGHT - 1));
+    return proj;
+}
+
+static long long march_packet_neon(const VoxelFrame *frame, int first)
+{
+    const TerrainTexel *texels = frame->texels;
+
+    const int32_t laneOffsets[4] = { 0, 1, 2, 3 };
+    float32x4_t columns = vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(first), vld1q_s32(laneOffsets)));
+    float32x4_t deltaX = vmulq_f32(vaddq_f32(vdupq_n_f32(frame->plx), vmulq_f32(vmulq_f32(vdupq_n_f32(frame->prx - frame->plx), columns), vdupq_n_f32(frame->invRenderWidth))), vdupq_n_f32(frame->invZfar));
+    float32x4_t deltaY = vmulq_f32(vaddq_f32(vdupq_n_f32(frame->ply), vmulq_f32(vmulq_f32(vdupq_n_f32(frame->pry - frame->ply), columns), vdupq_n_f32(frame->invRenderWidth))), vdupq_n_f32(frame->invZfar));
+
+    float32x4_t rx = vaddq_f32(vdupq_n_f32(frame->startRX), vmulq_f32(deltaX, vdupq_n_f32(frame->initialStep)));
+    float32x4_t ry = vaddq_f32(vdupq_n_f32(frame->startRY), vmulq_f32(deltaY, vdupq_n_f32(frame->initialStep)));
+
+    float lean[PACKET_MAX_LANES];
+    for (int lane = 0; lane < 4; lane++) lean[lane] = column_lean(frame, first + lane);
+
+    float32x4_t maxHeight = vdupq_n_f32((float)RENDER_HEIGHT);
+    int z = 1;
+
+    for (; z < frame->zfarInt; z++) {
+        rx = vaddq_f32(rx, deltaX);
+        ry = vaddq_f32(ry, deltaY);
+
+        int32_t x0[4], y0[4];
+        float32x4_t h = sample_height_neon(texels, rx, ry, x0, y0);
+        int32x4_t proj = project_height_neon(frame, h, z);
+
+        float32x4_t projF = vcvtq_f32_s32(proj);
+        uint32x4_t visible = vcltq_f32(projF, maxHeight);
+
+        if (vmaxvq_u32(visible)) {
+            int32_t rows[4];
+            uint32_t visibleLanes[4];
+            float limits[4];
+            vst1q_s32(rows, proj);
+            vst1q_u32(visibleLanes, visible);
+            vst1q_f32(limits, maxHeight);
+
+            for (int lane = 0; lane < 4; lane++) {
+                if (!visibleLanes[lane]) continue;
+                draw_span(frame, first + lane, z, terrain_texel_color(texels[MAP_N * y0[lane] + x0[lane]]), rows[lane], limits[lane], lean[lane]);
+            }
+
+            maxHeight = vbslq_f32(visible, projF, maxHeight);
+            if (vmaxvq_f32(maxHeight) <= 0.0f) break;
+        }
+    }
+
+    float limits[PACKET_MAX_LANES];
+    vst1q_f32(limits, maxHeight);
+    for (int lane = 0; lane < 4; lane++) finish_column(frame, first + lane, limits[lane], lean[lane]);
+
+    // Iterations run, the one that broke out included
+    return (long long)(z < frame->zfarInt ? z : frame->zfarInt - 1) * 4;
+}
+
+static void march_neon(const VoxelFrame *frame, int begin, int end)
+{
+    if (!frame->texels) {
+        march_scalar(frame, begin, end);
+        return;
+    }
+
+    long long steps = 0;
+    int i = begin;
+    for (; i + 4 <= end; i += 4) steps += march_packet_neon(frame, i);
+    count_steps(frame, steps);
+    march_scalar(frame, i, end);
+}
+
+static int bilinear_neon(const TerrainTexel *texels, const float *x, const float *y, float *heights, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32_t x0[4], y0[4];
+        vst1q_f32(heights + i, sample_height_neon(texels, vld1q_f32(x + i), vld1q_f32(y + i), x0, y0));
+    }
+    return i;
+}
+
+static int project_neon(const VoxelFrame *frame, const float *heights, int z, int *rows, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_s32(rows + i, project_height_neon(frame, vld1q_f32(heights + i), z));
+    }
+    return i;
+}
+
+#endif // VOXEL_NEON
+
+void voxel_march_lod(const VoxelFrame *frame, int begin, int end)
+{
+    if (!frame->texels || frame->levelCount == 0) {
+        march_scalar(frame, begin, end);
+        return;
+    }
+
+    int lodStart = frame->lodStart > 1 ? frame->lodStart : 1;
+    long long steps = 0;
+
+    for (int i = begin; i < end; i++) {
+        float deltaX = (frame->plx + (frame->prx - frame->plx) * i * frame->invRenderWidth) * frame->invZfar;
+        float deltaY = (frame->ply + (frame->pry - frame->ply) * i * frame->invRenderWidth) * frame->invZfar;
+
+        float rx = frame->startRX + deltaX * frame->initialStep;
+        float ry = frame->startRY + deltaY * frame->initialStep;
+
+        float maxHeight = (float)RENDER_HEIGHT;
+        float lean = column_lean(frame, i);
+
+        int step = 1;
+        int nextBand = lodStart;
+        int level = 0;
+        const TerrainTexel *texels = frame->levels[0];
+        int size = MAP_N;
+        float levelScale = 1.0f;
+        float levelOffset = 0.0f;
+
+        for (int z = 1; z < frame->zfarInt; z += step) {
+            rx += deltaX * step;
+            ry += deltaY * step;
+
+            steps++;
+
+            // Texel j of a level averages texels [j << level, (j + 1) << level) of level 0
+            int cell;
+            float h = sample_height(texels, size, rx * levelScale - levelOffset, ry * levelScale - levelOffset, &cell);
+            int projHeight = project_height(frame, h, z);
+
+            if (projHeight < maxHeight) {
+                draw_span(frame, i, z, terrain_texel_color(texels[cell]), projHeight, maxHeight, lean);
+                maxHeight = (float)projHeight;
+                if (maxHeight <= 0.0f) break;
+            }
+
+            if (z + step >= nextBand) {
+                step *= 2;
+                nextBand *= 2;
+                if (level + 1 < frame->levelCount) {
+                    level++;
+                    texels = frame->levels[level];
+                    size = MAP_N >> level;
+                    levelScale = 1.0f / (float)(1 << level);
+                    levelOffset = 0.5f * (float)((1 << level) - 1) * levelScale;
+                }
+            }
+        }
+
+        finish_column(frame, i, maxHeight, lean);
+    }
+
+    count_steps(frame, steps);
+}
+
+// Number of steps j >= 0 for which p + j * d stays inside [lo, hi). Only an
+// estimate; callers re-check the actual positions.
+static inline int steps_inside(float p, float d, float lo, float hi, int limit)
+{
+    float steps;
+    if (d > 0.0f) steps = ceilf((hi - p) / d);
+    else if (d < 0.0f) steps = floorf((p - lo) / -d) + 1.0f;
+    else return limit;
+    return steps < (float)limit ? (int)steps : limit;
+}
+
+// Region of a column proven to stay under its occlusion line
+typedef struct
+{
+    int lastZ;
+    float minX, maxX;
+    float minY, maxY;
+} EmptySpan;
+
+// Looks for the largest max-height block around the next sample position
+// that cannot rise above maxHeight while the ray crosses it. A block that
+// is too high at one level is also too high at every coarser level, so the
+// search walks up from single cells and stops at the first failure.
+static void find_empty_span(const VoxelFrame *frame, float nextX, float nextY, float deltaX, float deltaY, int z, float maxHeight, EmptySpan *span)
+{
+    int cellX = (int)floorf(nextX);
+    int cellY = (int)floorf(nextY);
+    span->lastZ = 0;
+
+    for (int level = 0; level < frame->maxHeightLevelCount; level++) {
+        int blockSize = 1 << level;
+        int blockX = cellX >> level;
+        int blockY = cellY >> level;
+        float minX = (float)(blockX * blockSize);
+        float minY = (float)(blockY * blockSize);
+
+        int limit = frame->zfarInt - 1 - z;
+        int steps = steps_inside(nextX, deltaX, minX, minX + blockSize, limit);
+        int stepsY = steps_inside(nextY, deltaY, minY, minY + blockSize, limit);
+        if (stepsY < steps) steps = stepsY;
+        if (steps < 1) break;
+
+        int levelSize = MAP_N >> level;
+        int wrapped = (blockY & (levelSize - 1)) * levelSize + (blockX & (levelSize - 1));
+        // Half a unit of headroom covers rounding in the bilinear blend
+        float blockHeight = frame->maxHeights[level][wrapped] + 0.5f;
+
+        // The projection is monotonic in depth, so the extremes sit at either end
+        int lastZ = z + steps;
+        int nearRow = project_height(frame, blockHeight, z + 1);
+        int farRow = project_height(frame, blockHeight, lastZ);
+        if (nearRow < maxHeight || farRow < maxHeight) break;
+
+        *span = (EmptySpan){ lastZ, minX, minX + blockSize, minY, minY + blockSize };
+    }
+}
+
+void voxel_march_skip(const VoxelFrame *frame, int begin, int end)
+{
+    const TerrainTexel *texels = frame->texels;
+    if (!texels || frame->maxHeightLevelCount == 0) {
+        march_scalar(frame, begin, end);
+        return;
+    }
+
+    long long steps = 0;
+
+    for (int i = begin; i < end; i++) {
+        float deltaX = (frame->plx + (frame->prx - frame->plx) * i * frame->invRenderWidth) * frame->invZfar;
+        float deltaY = (frame->ply + (frame->pry - frame->ply) * i * frame->invRenderWidth) * frame->invZfar;
+
+        float rx = frame->startRX + deltaX * frame->initialStep;
+        float ry = frame->startRY + deltaY * frame->initialStep;
+
+        float maxHeight = (float)RENDER_HEIGHT;
+        float lean = column_lean(frame, i);
+        EmptySpan span = { 0 };
+
+        for (int z = 1; z < frame->zfarInt; z++) {
+            // Positions are still accumulated one step at a time so the
+            // samples after a skip match the unskipped march exactly
+            rx += deltaX;
+            ry += deltaY;
+
+            if (z <= span.lastZ &&
+                rx >= span.minX && rx < span.maxX &&
+                ry >= span.minY && ry < span.maxY) continue;
+
+            steps++;
+
+            int cell;
+            float h = sample_height(texels, MAP_N, rx, ry, &cell);
+            int projHeight = project_height(frame, h, z);
+
+            if (projHeight < maxHeight) {
+                draw_span(frame, i, z, terrain_texel_color(texels[cell]), projHeight, maxHeight, lean);
+                maxHeight = (float)projHeight;
+                if (maxHeight <= 0.0f) break;
+            }
+
+            find_empty_span(frame, rx + deltaX, ry + deltaY, deltaX, deltaY, z, maxHeight, &span);
+        }
+
+        finish_column(frame, i, maxHeight, lean);
+    }
+
+    count_steps(frame, steps);
+}
+
+// sample_height() through the page table. (x0, y0) and its three
+// neighbours are always in the same page thanks to the border, and the
+// blend is the same expression, so the heights match sample_height()'s.
+static inline float sample_height_paged(const VoxelPageTable *pages, float x, float y, TerrainTexel *texel)
+{
+    float floorX = floorf(x);
+    float floorY = floorf(y);
+    float fx = x - floorX;
+    float fy = y - floorY;
+
+    int worldX = (int)floorX & ((VOXEL_PAGE_N << pages->shiftX) - 1);
+    int worldY = (int)floorY & ((VOXEL_PAGE_N << pages->shiftY) - 1);
+    const TerrainTexel *page = pages->table[((worldY >> VOXEL_PAGE_SHIFT) << pages->shiftX) + (worldX >> VOXEL_PAGE_SHIFT)];
+    const TerrainTexel *t = page + (worldY & (VOXEL_PAGE_N - 1)) * VOXEL_PAGE_STRIDE + (worldX & (VOXEL_PAGE_N - 1));
+
+    float h00 = t[0].height;
+    float h10 = t[1].height;
+    float h01 = t[VOXEL_PAGE_STRIDE].height;
+    float h11 = t[VOXEL_PAGE_STRIDE + 1].height;
+
+    *texel = t[0];
+
+    return h00 * (1.0f - fx) * (1.0f - fy) +
+           h10 * fx * (1.0f - fy) +
+           h01 * (1.0f - fx) * fy +
+           h11 * fx * fy;
+}
+
+void voxel_march_paged(const VoxelFrame *frame, int begin, int end)
+{
+    const VoxelPageTable *pages = &frame->pages;
+    if (!pages->table) {
+        march_scalar(frame, begin, end);
+        return;
+    }
+
+    long long steps = 0;
+
+    for (int i = begin; i < end; i++) {
+        float deltaX = (frame->plx + (frame->prx - frame->plx) * i * frame->invRenderWidth) * frame->invZfar;
+        float deltaY = (frame->ply + (frame->pry - frame->ply) * i * frame->invRenderWidth) * frame->invZfar;
+
+        float rx = frame->startRX + deltaX * frame->initialStep;
+        float ry = frame->startRY + deltaY * frame->initialStep;
+
+        float maxHeight = (float)RENDER_HEIGHT;
+        float lean = column_lean(frame, i);
+
+        for (int z = 1; z < frame->zfarInt; z++) {
+            rx += deltaX;
+            ry += deltaY;
+            steps++;
+
+            TerrainTexel texel;
+            float h = sample_height_paged(pages, rx, ry, &texel);
+            int projHeight = project_height(frame, h, z);
+
+            if (projHeight < maxHeight) {
+                draw_span(frame, i, z, terrain_texel_color(texel), projHeight, maxHeight, lean);
+                maxHeight = (float)projHeight;
+                if (maxHeight <= 0.0f) break;
+            }
+        }
+
+        finish_column(frame, i, maxHeight, lean);
+    }
+
+    count_steps(frame, steps);
+}
+
+// Rows of a column-major tile handled per pass of voxel_transpose_columns().
+// Small enough that the source runs of a 32-column tile stay in L1 between
+// passes, while every destination row gets a full cache line or more.
+#define TRANSPOSE_BLOCK_ROWS 16
+
+static inline void transpose_scalar(const Color *columns, Color *rows, int x, int y, int width, int height)
+{
+    for (int row = y; row < y + height; row++) {
+        for (int column = x; column < x + width; column++) {
+            rows[row * RENDER_WIDTH + column] = columns[(size_t)column * RENDER_HEIGHT + row];
+        }
+    }
+}
+
+#if defined(__SSE2__)
+// 4x4 block: four column runs in, four row runs out
+static inline void transpose_4x4(const Color *columns, Color *rows, int x, int y)
+{
+    const Color *src = columns + (size_t)x * RENDER_HEIGHT + y;
+    __m128 c0 = _mm_loadu_ps((const float *)(src));
+    __m128 c1 = _mm_loadu_ps((const float *)(src + RENDER_HEIGHT));
+    __m128 c2 = _mm_loadu_ps((const float *)(src + 2 * RENDER_HEIGHT));
+    __m128 c3 = _mm_loadu_ps((const float *)(src + 3 * RENDER_HEIGHT));
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    Color *dst = rows + y * RENDER_WIDTH + x;
+    _mm_storeu_ps((float *)(dst), c0);
+    _mm_storeu_ps((float *)(dst + RENDER_WIDTH), c1);
+    _mm_storeu_ps((float *)(dst + 2 * RENDER_WIDTH), c2);
+    _mm_storeu_ps((float *)(dst + 3 * RENDER_WIDTH), c3);
+}
+#define VOXEL_TRANSPOSE_4X4 1
+#elif VOXEL_NEON
+static inline void transpose_4x4(const Color *columns, Color *rows, int x, int y)
+{
+    const uint32_t *src = (const uint32_t *)(columns + (size_t)x * RENDER_HEIGHT + y);
+    uint32x4_t c0 = vld1q_u32(src);
+    uint32x4_t c1 = vld1q_u32(src + RENDER_HEIGHT);
+    uint32x4_t c2 = vld1q_u32(src + 2 * RENDER_HEIGHT);
+    uint32x4_t c3 = vld1q_u32(src + 3 * RENDER_HEIGHT);
+    uint32x4x2_t t01 = vtrnq_u32(c0, c1);
+    uint32x4x2_t t23 = vtrnq_u32(c2, c3);
+
+    uint32_t *dst = (uint32_t *)(rows + y * RENDER_WIDTH + x);
+    vst1q_u32(dst, vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0])));
+    vst1q_u32(dst + RENDER_WIDTH, vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1])));
+    vst1q_u32(dst + 2 * RENDER_WIDTH, vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0])));
+    vst1q_u32(dst + 3 * RENDER_WIDTH, vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1])));
+}
+#define VOXEL_TRANSPOSE_4X4 1
+#endif
+
+void voxel_transpose_columns(const Color *columns, Color *rows, int begin, int end)
+{
+    for (int y = 0; y < RENDER_HEIGHT; y += TRANSPOSE_BLOCK_ROWS) {
+        int height = RENDER_HEIGHT - y < TRANSPOSE_BLOCK_ROWS ? RENDER_HEIGHT - y : TRANSPOSE_BLOCK_ROWS;
+        int x = begin;
+#if VOXEL_TRANSPOSE_4X4
+        int blockRows = height & ~3;
+        for (; x + 4 <= end; x += 4) {
+            for (int row = y; row < y + blockRows; row += 4) transpose_4x4(columns, rows, x, row);
+        }
+        if (blockRows < height) transpose_scalar(columns, rows, begin, y + blockRows, x - begin, height - blockRows);
+#endif
+        transpose_scalar(columns, rows, x, y, end - x, height);
+    }
+}
+
+void voxel_op_bilinear(VoxelKernel kernel, const TerrainTexel *texels, const float *x, const float *y, float *heights, int count)
+{
+    int i = 0;
+    switch (voxel_kernel_resolve(kernel)) {
+#if VOXEL_X86
+        case VOXEL_KERNEL_AVX2: i = bilinear_avx2(texels, x, y, heights, count); break;
+        case VOXEL_KERNEL_SSE2: i = bilinear_sse2(texels, x, y, heights, count); break;
+#endif
+#if VOXEL_NEON
+        case VOXEL_KERNEL_NEON: i = bilinear_neon(texels, x, y, heights, count); break;
+#endif
+        default: break;
+    }
+
+    for (; i < count; i++) {
+        int cell;
+        heights[i] = sample_height(texels, MAP_N, x[i], y[i], &cell);
+    }
+}
+
+void voxel_op_bilinear_fixed(const TerrainTexel *texels, const uint32_t *x, const uint32_t *y, int32_t *heights, int count)
+{
+    for (int i = 0; i < count; i++) {
+        int cell;
+        heights[i] = sample_height_fixed(texels, x[i], y[i], &cell);
+    }
+}
+
+void voxel_op_project(VoxelKernel kernel, const VoxelFrame *frame, const float *heights, int z, int *rows, int count)
+{
+    int i = 0;
+    switch (voxel_kernel_resolve(kernel)) {
+#if VOXEL_X86
+        case VOXEL_KERNEL_AVX2: i = project_avx2(frame, heights, z, rows, count); break;
+        case VOXEL_KERNEL_SSE2: i = project_sse2(frame, heights, z, rows, count); break;
+#endif
+#if VOXEL_NEON
+        case VOXEL_KERNEL_NEON: i = project_neon(frame, heights, z, rows, count); break;
+#endif
+        default: break;
+    }
+
+    for (; i < count; i++) rows[i] = project_height(frame, heights[i], z);
+}
+
+void voxel_op_project_fixed(const VoxelFrame *frame, const int32_t *heights, int z, int *rows, int count)
+{
+    int64_t camHeight = (int64_t)(frame->camHeight * 65536.0f);
+    int64_t horizon = (int64_t)(frame->horizon * 65536.0f);
+    int32_t invZ = frame->invZTable[z];
+
+    for (int i = 0; i < count; i++) rows[i] = project_height_fixed(invZ, camHeight, horizon, heights[i]);
+}
+
+void voxel_op_fog(const VoxelFrame *frame, const Color *pixels, int z, Color *out, int count)
+{
+    const VoxelFogEntry *fog = &frame->fogTable[z];
+    for (int i = 0; i < count; i++) out[i] = fog_blend(fog, pixels[i]);
+}
+
+void voxel_op_fill(const VoxelFrame *frame, int column, int startY, int endY, Color color)
+{
+    fill_column(frame, column, startY, endY, color);
+}
+
+void voxel_fog_build(VoxelFogEntry *table, const float *factors, int count, Color fog)
+{
+    uint32_t f;
+    memcpy(&f, &fog, sizeof(f));
+    uint32_t fogRB = f & 0x00FF00FF;
+    uint32_t fogGA = (f >> 8) & 0x00FF00FF;
+
+    for (int z = 0; z < count; z++) {
+        float factor = factors[z];
+        if (factor < 0.0f) factor = 0.0f;
+        if (factor > 1.0f) factor = 1.0f;
+
+        uint32_t weight = (uint32_t)(factor * 256.0f + 0.5f);
+        table[z] = (VoxelFogEntry){
+            .weight = weight,
+            .fogRB = fogRB * (256 - weight),
+            .fogGA = fogGA * (256 - weight),
+        };
+    }
+}
+
+void voxel_fog_palettes_build(Color *palettes, const Color *palette, const VoxelFogEntry *table, int count)
+{
+    bool built[VOXEL_FOG_WEIGHTS] = { false };
+
+    for (int z = 0; z < count; z++) {
+        uint32_t weight = table[z].weight;
+        if (built[weight]) continue;
+        built[weight] = true;
+
+        Color *row = palettes + weight * TERRAIN_PALETTE_SIZE;
+        for (int i = 0; i < TERRAIN_PALETTE_SIZE; i++) row[i] = fog_blend(&table[z], palette[i]);
+    }
+}
+
+void voxel_inv_z_build(int32_t *table, int count, float depthOffset)
+{
+    VoxelFrame frame = { .depthOffset = depthOffset };
+    table[0] = 0;
+    for (int z = 1; z < count; z++) {
+        table[z] = (int32_t)(SCALE_FACTOR / continuous_z(&frame, z) * 65536.0);
+    }
+}
+
+bool voxel_kernel_supported(VoxelKernel kernel)
+{
+    switch (kernel) {
+        case VOXEL_KERNEL_SCALAR:
+        case VOXEL_KERNEL_FIXED:
+            return true;
+#if VOXEL_X86
+        case VOXEL_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case VOXEL_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#if VOXEL_NEON
+        case VOXEL_KERNEL_NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+VoxelKernel voxel_kernel_resolve(VoxelKernel kernel)
+{
+    if (kernel != VOXEL_KERNEL_AUTO && voxel_kernel_supported(kernel)) return kernel;
+
+    if (voxel_kernel_supported(VOXEL_KERNEL_AVX2)) return VOXEL_KERNEL_AVX2;
+    if (voxel_kernel_supported(VOXEL_KERNEL_NEON)) return VOXEL_KERNEL_NEON;
+    if (voxel_kernel_supported(VOXEL_KERNEL_SSE2)) return VOXEL_KERNEL_SSE2;
+    return VOXEL_KERNEL_SCALAR;
+}
+
+VoxelKernelFn voxel_kernel_function(VoxelKernel kernel)
+{
+    switch (voxel_kernel_resolve(kernel)) {
+#if VOXEL_X86
+        case VOXEL_KERNEL_AVX2: return march_avx2;
+        case VOXEL_KERNEL_SSE2: return march_sse2;
+#endif
+#if VOXEL_NEON
+        case VOXEL_KERNEL_NEON: return march_neon;
+#endif
+        case VOXEL_KERNEL_FIXED: return march_fixed;
+        default: return march_scalar;
+    }
+}
+
+const char *voxel_kernel_name(VoxelKernel kernel)
+{
+    switch (kernel) {
+        case VOXEL_KERNEL_AUTO:   return "auto";
+        case VOXEL_KERNEL_SCALAR: return "scalar";
+        case VOXEL_KERNEL_SSE2:   return "sse2";
+        case VOXEL_KERNEL_AVX2:   return "avx2";
+        case VOXEL_KERNEL_NEON:   return "neon";
+        case VOXEL_KERNEL_FIXED:  return "fixed";
+        default:                  return "unknown";
+    }
+}
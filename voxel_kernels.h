@@ -0,0 +1,202 @@
+#ifndef VOXEL_KERNELS_H
+#define VOXEL_KERNELS_H
+
+#include <raylib.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "terrain.h"
+
+// Deepest z a column can march to; sizes the per-depth tables. Only the
+// LOD and paged kernels go past MAP_N, the others stop there.
+#define VOXEL_MAX_DEPTH 4096
+
+// Paged worlds are split into square pages of VOXEL_PAGE_N texels. Each
+// page is stored VOXEL_PAGE_STRIDE texels wide and tall, with the first
+// row and column of its right and lower neighbours repeated at the end, so
+// every bilinear footprint lies inside a single page.
+#define VOXEL_PAGE_SHIFT 8
+#define VOXEL_PAGE_N (1 << VOXEL_PAGE_SHIFT)
+#define VOXEL_PAGE_STRIDE (VOXEL_PAGE_N + 1)
+#define VOXEL_PAGE_TEXELS (VOXEL_PAGE_STRIDE * VOXEL_PAGE_STRIDE)
+
+// A world of (1 << shiftX) x (1 << shiftY) pages, wrapping at its edges.
+// Every entry points at a valid page; ones that are not loaded share a
+// placeholder, so sampling never has to check.
+typedef struct
+{
+    const TerrainTexel *const *table; // row by row
+    int shiftX;
+    int shiftY;
+} VoxelPageTable;
+
+// Counters the kernels accumulate into while rendering a frame
+typedef struct
+{
+    atomic_llong raySteps; // height samples taken, summed over all columns
+} VoxelStats;
+
+// Fog for one depth slice in 8-bit fixed point: a texel at that depth
+// becomes (texel * weight + fog * (256 - weight)) / 256 per channel. The
+// fog term is premultiplied and kept two channels per word (R and B, G and
+// A, 16 bits each), the layout the packed blend works in.
+typedef struct
+{
+    uint32_t weight;
+    uint32_t fogRB;
+    uint32_t fogGA;
+} VoxelFogEntry;
+
+// Fills table[0..count) from per-depth fog factors in [0, 1], where 1
+// leaves the texel untouched and 0 replaces it with the fog color
+void voxel_fog_build(VoxelFogEntry *table, const float *factors, int count, Color fog);
+
+// Fog weights voxel_fog_build() produces, 0 to 256
+#define VOXEL_FOG_WEIGHTS 257
+
+// Fogs a terrain palette once per fog weight found in table[0..count):
+// row w of palettes (TERRAIN_PALETTE_SIZE colors) becomes palette blended
+// with weight w, exactly as the per-pixel blend would. Rows for weights
+// that do not occur are left untouched.
+void voxel_fog_palettes_build(Color *palettes, const Color *palette, const VoxelFogEntry *table, int count);
+
+// Everything a column needs to march, captured once per frame so that
+// columns can be rendered from any thread
+typedef struct
+{
+    const TerrainTexel *texels;
+    const TerrainTexel *levels[TERRAIN_MAX_LEVELS];
+    int levelCount;
+    const uint8_t *maxHeights[TERRAIN_MAX_HEIGHT_LEVELS];
+    int maxHeightLevelCount;
+    const VoxelFogEntry *fogTable;
+    const int32_t *invZTable; // SCALE_FACTOR / continuous depth, 16.16; fixed kernel only
+    Color *target;
+    Color sky; // written above the terrain in each column
+    int *columnWrites; // pixels stored per column are added here when set
+
+    // target stores each column's RENDER_HEIGHT pixels contiguously instead
+    // of row by row, so span fills are linear; voxel_transpose_columns()
+    // turns it back into rows for upload
+    bool columnMajor;
+
+    // Ray origin, in [0, MAP_N) unless the frame is paged
+    float startRX;
+    float startRY;
+    float camHeight;
+    float depthOffset;
+    float initialStep;
+
+    float plx, ply;
+    float prx, pry;
+    float invZfar;
+    float invRenderWidth;
+    int zfarInt;
+
+    float horizon;
+    float tilt;
+
+    bool lod;
+    int lodStart;
+    bool skipEmpty;
+
+    // Index and height planes of texels and VOXEL_FOG_WEIGHTS rows of
+    // fogged palettes, for voxel_march_palette()
+    const uint8_t *colorIndices;
+    const uint8_t *heights;
+    const Color *fogPalettes;
+
+    // Set for a paged world, which voxel_march_paged() renders instead of texels
+    VoxelPageTable pages;
+
+    VoxelStats *stats;
+} VoxelFrame;
+
+// Renders columns [begin, end) of the frame
+typedef void (*VoxelKernelFn)(const VoxelFrame *frame, int begin, int end);
+
+// Column marching implementations. The packet kernels march several
+// adjacent columns per instruction stream and produce the same pixels as
+// the scalar one. The fixed-point kernel trades exactness for integer
+// sampling and projection and is never picked by AUTO.
+typedef enum
+{
+    VOXEL_KERNEL_AUTO,
+    VOXEL_KERNEL_SCALAR,
+    VOXEL_KERNEL_SSE2,
+    VOXEL_KERNEL_AVX2,
+    VOXEL_KERNEL_NEON,
+    VOXEL_KERNEL_FIXED, // 16.16 sampling and projection, within VOXEL_FIXED_TOLERANCE of scalar
+    VOXEL_KERNEL_COUNT
+} VoxelKernel;
+
+bool voxel_kernel_supported(VoxelKernel kernel);
+
+// Picks the fastest kernel the CPU supports for AUTO or unsupported requests
+VoxelKernel voxel_kernel_resolve(VoxelKernel kernel);
+
+VoxelKernelFn voxel_kernel_function(VoxelKernel kernel);
+
+const char *voxel_kernel_name(VoxelKernel kernel);
+
+// Fills table[z] with SCALE_FACTOR / (z - depthOffset) in 16.16 for the
+// fixed-point kernel, using the same near clamp as the float projection
+void voxel_inv_z_build(int32_t *table, int count, float depthOffset);
+
+// The fixed-point kernel's error budget against the scalar kernel: at most
+// VOXEL_FIXED_TOLERANCE_PERMILLE of the pixels of a frame may differ from
+// it by more than VOXEL_FIXED_TOLERANCE in any channel. Rays visit the same
+// cells, so differences come from the 16-bit bilinear weights and the
+// reciprocal projection moving span edges by a row.
+#define VOXEL_FIXED_TOLERANCE 2
+#define VOXEL_FIXED_TOLERANCE_PERMILLE 10
+
+// Distance-based LOD kernel: the step size doubles every time the distance
+// doubles past frame->lodStart, and sampling moves down the mip chain with
+// it. Scalar only; used instead of the kernels above when frame->lod is set.
+void voxel_march_lod(const VoxelFrame *frame, int begin, int end);
+
+// Scalar kernel that uses the terrain's max-height pyramid to step over
+// blocks that cannot rise above the column's current occlusion line.
+// Produces the same pixels as the scalar kernel with fewer samples.
+void voxel_march_skip(const VoxelFrame *frame, int begin, int end);
+
+// Scalar kernel over frame->heights and frame->colorIndices: each height
+// sample reads one byte instead of a 4-byte texel, a color index is read
+// only for a drawn span, and the shaded color comes straight from the
+// fogged palette of the span's depth, with no per-pixel blend. Produces
+// the same pixels as the scalar kernel.
+void voxel_march_palette(const VoxelFrame *frame, int begin, int end);
+
+// Scalar kernel over frame->pages, sampling exactly like the scalar kernel
+// does a single map: a world of pages cut from one map renders the same.
+// One table lookup per sample, no residency checks. Ignores lod and
+// skipEmpty.
+void voxel_march_paged(const VoxelFrame *frame, int begin, int end);
+
+// Copies columns [begin, end) of a column-major frame into the row-major
+// image, in cache-sized blocks with 4x4 SIMD transposes where available
+void voxel_transpose_columns(const Color *columns, Color *rows, int begin, int end);
+
+// The kernels' inner-loop operations over arrays, built from the same
+// inline code the kernels use, so bench_kernels can time each on its own.
+// The float ones take the code path of the given kernel (AUTO, SCALAR,
+// SSE2, AVX2 or NEON) and produce the same values as that kernel.
+
+void voxel_op_bilinear(VoxelKernel kernel, const TerrainTexel *texels, const float *x, const float *y, float *heights, int count);
+
+// 16.16 positions in, 16.16 heights out, as in the fixed-point kernel
+void voxel_op_bilinear_fixed(const TerrainTexel *texels, const uint32_t *x, const uint32_t *y, int32_t *heights, int count);
+
+// Screen rows of heights at depth z
+void voxel_op_project(VoxelKernel kernel, const VoxelFrame *frame, const float *heights, int z, int *rows, int count);
+
+// Needs frame->invZTable
+void voxel_op_project_fixed(const VoxelFrame *frame, const int32_t *heights, int z, int *rows, int count);
+
+// Blends pixels with the fog of depth z from frame->fogTable
+void voxel_op_fog(const VoxelFrame *frame, const Color *pixels, int z, Color *out, int count);
+
+// Fills rows [startY, endY) of a column in frame->target's layout
+void voxel_op_fill(const VoxelFrame *frame, int column, int startY, int endY, Color color);
+
+#endif // VOXEL_KERNELS_H
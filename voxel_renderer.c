@@ -0,0 +1,262 @@
+#include "voxel_renderer.h"
+#include "voxel_space_map.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Columns per tile handed to a render thread
+#define RENDER_TILE_COLUMNS 32
+
+static size_t rendererAllocations = 0;
+
+VoxelRenderConfig voxel_render_config_default(void)
+{
+    return (VoxelRenderConfig){
+        .horizon = 100.0f,
+        .tilt = 0.0f,
+        .zfar = 600.0f,
+        .fogType = 0,
+        .fogDensity = 0.0025f,
+        .fogStart = 300.0f,
+        .fogEnd = 600.0f,
+        .fogColor = (Color){ 180, 180, 180, 255 },
+        .linearFogColor = (Color){ 180, 180, 180, 100 },
+        .sky = (Color){ 0, 0, 0, 0 }, // Transparent, the clear color shows through
+        .lod = false,
+        .lodStart = 256,
+        .skipEmpty = false,
+        .columnMajor = false,
+        .palettized = false,
+    };
+}
+
+bool voxel_renderer_init(VoxelRenderer *renderer, const Terrain *terrain, Color *pixels, VoxelRenderConfig config)
+{
+    *renderer = (VoxelRenderer){ 0 };
+    renderer->terrain = terrain;
+    renderer->pixels = pixels;
+    renderer->config = config;
+
+    voxel_renderer_set_threads(renderer, 0);
+    voxel_renderer_set_kernel(renderer, VOXEL_KERNEL_AUTO);
+    return renderer->poolReady;
+}
+
+void voxel_renderer_free(VoxelRenderer *renderer)
+{
+    if (renderer->poolReady) worker_pool_shutdown(&renderer->pool);
+    free(renderer->columnBuffer);
+    free(renderer->fogPalettes);
+    renderer->poolReady = false;
+    renderer->columnBuffer = NULL;
+    renderer->fogPalettes = NULL;
+}
+
+void voxel_renderer_set_threads(VoxelRenderer *renderer, int count)
+{
+    if (renderer->poolReady) worker_pool_shutdown(&renderer->pool);
+    renderer->poolReady = worker_pool_init(&renderer->pool, count);
+    if (!renderer->poolReady) {
+        TraceLog(LOG_WARNING, "VOXEL: Falling back to single threaded rendering");
+        renderer->poolReady = worker_pool_init(&renderer->pool, 1);
+    }
+}
+
+void voxel_renderer_set_kernel(VoxelRenderer *renderer, VoxelKernel kernel)
+{
+    renderer->kernel = voxel_kernel_resolve(kernel);
+    renderer->kernelFn = voxel_kernel_function(renderer->kernel);
+    if (kernel != VOXEL_KERNEL_AUTO && kernel != renderer->kernel) {
+        TraceLog(LOG_WARNING, "VOXEL: %s kernel not supported on this CPU, using %s", voxel_kernel_name(kernel), voxel_kernel_name(renderer->kernel));
+    }
+}
+
+size_t voxel_renderer_allocation_count(void)
+{
+    return rendererAllocations;
+}
+
+static bool same_color(Color a, Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+// Rebuilds the per-depth fog factors and blend entries when a fog setting changed
+static void update_fog_tables(VoxelRenderer *renderer)
+{
+    const VoxelRenderConfig *config = &renderer->config;
+    const VoxelRenderConfig *built = &renderer->fogTableConfig;
+    if (renderer->fogTableReady &&
+        built->fogDensity == config->fogDensity && built->fogType == config->fogType &&
+        built->fogStart == config->fogStart && built->fogEnd == config->fogEnd &&
+        same_color(built->fogColor, config->fogColor) &&
+        same_color(built->linearFogColor, config->linearFogColor)) return;
+
+    float fStart = config->fogStart;
+    float fEnd = config->fogEnd;
+    if (fEnd <= fStart) fEnd = fStart + 1.0f;
+
+    for (int z = 0; z < VOXEL_MAX_DEPTH; z++) {
+        if (config->fogType == 1) renderer->fogTable[z] = (fEnd - z) / (fEnd - fStart);
+        else renderer->fogTable[z] = 1.0f / expf(z * config->fogDensity);
+    }
+    Color color = config->fogType == 1 ? config->linearFogColor : config->fogColor;
+    voxel_fog_build(renderer->fogBlendTable, renderer->fogTable, VOXEL_MAX_DEPTH, color);
+
+    renderer->fogTableConfig = *config;
+    renderer->fogTableReady = true;
+    renderer->fogPalettesReady = false;
+}
+
+// Whether the terrain can be drawn through fogged palettes, (re)building them if needed
+static bool update_fog_palettes(VoxelRenderer *renderer)
+{
+    const Terrain *terrain = renderer->terrain;
+    if (!renderer->config.palettized || terrain == NULL || terrain->colorIndices == NULL) return false;
+
+    if (renderer->fogPalettes == NULL) {
+        renderer->fogPalettes = (Color *)malloc(VOXEL_FOG_WEIGHTS * TERRAIN_PALETTE_SIZE * sizeof(Color));
+        rendererAllocations++;
+        if (renderer->fogPalettes == NULL) return false;
+    }
+
+    // Another map may have been swapped into the same terrain
+    if (renderer->fogPalettesReady && memcmp(renderer->fogPaletteSource, terrain->palette, sizeof(terrain->palette)) == 0) return true;
+
+    memcpy(renderer->fogPaletteSource, terrain->palette, sizeof(terrain->palette));
+    voxel_fog_palettes_build(renderer->fogPalettes, terrain->palette, renderer->fogBlendTable, VOXEL_MAX_DEPTH);
+    renderer->fogPalettesReady = true;
+    return true;
+}
+
+static void render_columns(void *userData, int begin, int end)
+{
+    const VoxelRenderer *renderer = (const VoxelRenderer *)userData;
+    const VoxelFrame *frame = &renderer->frame;
+    if (frame->pages.table) voxel_march_paged(frame, begin, end);
+    else if (frame->lod) voxel_march_lod(frame, begin, end);
+    else if (frame->skipEmpty) voxel_march_skip(frame, begin, end);
+    else if (frame->colorIndices) voxel_march_palette(frame, begin, end);
+    else renderer->kernelFn(frame, begin, end);
+
+    // The tile's columns are still in cache, so transpose them right away
+    if (frame->columnMajor) voxel_transpose_columns(frame->target, renderer->pixels, begin, end);
+}
+
+void voxel_renderer_render(VoxelRenderer *renderer, Camera3D camera)
+{
+    const VoxelRenderConfig *config = &renderer->config;
+    const Terrain *terrain = renderer->terrain;
+
+    float zfar = config->zfar;
+    if (zfar < 2.0f) zfar = 2.0f;
+    if (zfar > VOXEL_MAX_DEPTH) zfar = VOXEL_MAX_DEPTH;
+
+    float camX = camera.position.x;
+    float camY = camera.position.z;
+    float camHeight = camera.position.y;
+    float camAngle = atan2f(camera.target.z - camera.position.z, camera.target.x - camera.position.x);
+
+    // Calculate fractional movement to fix Z-judder
+    // We assume the forward direction is roughly aligned with the camera target
+    float dirX = camera.target.x - camera.position.x;
+    float dirZ = camera.target.z - camera.position.z;
+    float dirLen = sqrtf(dirX*dirX + dirZ*dirZ);
+    if (dirLen > 0) {
+        dirX /= dirLen;
+        dirZ /= dirLen;
+    }
+
+    // depthOffset is how much we have moved "into" the current map grid unit
+    // along the look direction.
+    float depthOffset = (camX * dirX + camY * dirZ);
+    depthOffset -= floorf(depthOffset);
+
+    update_fog_tables(renderer);
+    bool palettized = update_fog_palettes(renderer);
+
+    if (config->columnMajor && renderer->columnBuffer == NULL) {
+        renderer->columnBuffer = (Color *)malloc(RENDER_WIDTH * RENDER_HEIGHT * sizeof(Color));
+        rendererAllocations++;
+    }
+    bool columnMajor = config->columnMajor && renderer->columnBuffer;
+
+    float sinangle = sin(camAngle);
+    float cosangle = cos(camAngle);
+
+    VoxelFrame frame = {
+        .texels = terrain ? terrain->texels : NULL,
+        .fogTable = renderer->fogBlendTable,
+        .invZTable = renderer->invZTable,
+        .target = columnMajor ? renderer->columnBuffer : renderer->pixels,
+        .columnMajor = columnMajor,
+        .sky = config->sky,
+        .camHeight = camHeight,
+        .depthOffset = depthOffset,
+        .plx = cosangle * zfar + sinangle * zfar,
+        .ply = sinangle * zfar - cosangle * zfar,
+        .prx = cosangle * zfar - sinangle * zfar,
+        .pry = sinangle * zfar + cosangle * zfar,
+        .invZfar = 1.0f / zfar,
+        .invRenderWidth = 1.0f / (float)RENDER_WIDTH,
+        .zfarInt = (int)zfar,
+        .horizon = config->horizon,
+        .tilt = config->tilt,
+        .lod = config->lod,
+        .lodStart = config->lodStart > 1 ? config->lodStart : 1,
+        .skipEmpty = config->skipEmpty,
+        .stats = &renderer->stats,
+        .columnWrites = renderer->columnWrites,
+    };
+    if (terrain) {
+        frame.levelCount = terrain->levelCount;
+        frame.maxHeightLevelCount = terrain->maxHeightLevelCount;
+        for (int level = 0; level < terrain->levelCount; level++) frame.levels[level] = terrain->levels[level];
+        for (int level = 0; level < terrain->maxHeightLevelCount; level++) frame.maxHeights[level] = terrain->maxHeights[level];
+    }
+    if (palettized) {
+        frame.colorIndices = terrain->colorIndices;
+        frame.heights = terrain->heights;
+        frame.fogPalettes = renderer->fogPalettes;
+    }
+    if (renderer->pages) frame.pages = *renderer->pages;
+    atomic_store(&renderer->stats.raySteps, 0);
+    memset(renderer->columnWrites, 0, sizeof(renderer->columnWrites));
+
+    // A full-resolution ray would wrap around the map past MAP_N steps, or
+    // around a paged world past its smaller side
+    int maxDepth = config->lod ? VOXEL_MAX_DEPTH : MAP_N;
+    if (renderer->pages) {
+        int shift = renderer->pages->shiftX < renderer->pages->shiftY ? renderer->pages->shiftX : renderer->pages->shiftY;
+        maxDepth = VOXEL_PAGE_N << shift;
+    }
+    if (frame.zfarInt > maxDepth) frame.zfarInt = maxDepth;
+
+    // Use fractional Y (depth) to offset the starting sampling position
+    // We offset the start to align exactly with the camera world position
+    frame.startRX = camX;
+    frame.startRY = camY;
+
+    // The map repeats, so start in its first copy: float ray positions then
+    // stay small and precise however far the camera has travelled. Paged
+    // worlds sample in world coordinates.
+    if (!renderer->pages) {
+        frame.startRX -= MAP_N * floorf(camX / MAP_N);
+        frame.startRY -= MAP_N * floorf(camY / MAP_N);
+    }
+
+    // Adjust start position by one half step to center sampling on the first slice
+    // This further stabilizes the forward movement
+    frame.initialStep = 1.0f - depthOffset;
+
+    // The reciprocals depend on depthOffset, so they change every frame
+    if (renderer->kernel == VOXEL_KERNEL_FIXED) voxel_inv_z_build(renderer->invZTable, frame.zfarInt, depthOffset);
+
+    // Columns are independent, so split them into tiles across the pool
+    renderer->frame = frame;
+    worker_pool_run(&renderer->pool, RENDER_WIDTH, RENDER_TILE_COLUMNS, render_columns, renderer);
+    renderer->lastRaySteps = atomic_load(&renderer->stats.raySteps);
+
+    renderer->lastPixelsWritten = 0;
+    for (int column = 0; column < RENDER_WIDTH; column++) renderer->lastPixelsWritten += renderer->columnWrites[column];
+}
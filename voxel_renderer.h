@@ -0,0 +1,96 @@
+#ifndef VOXEL_RENDERER_H
+#define VOXEL_RENDERER_H
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "terrain.h"
+#include "voxel_kernels.h"
+#include "voxel_space_map.h"
+#include "worker_pool.h"
+
+// Per-frame settings, read by every voxel_renderer_render() call. The
+// fields can be changed freely between frames; threads and kernel are
+// applied through their setters below instead.
+typedef struct
+{
+    float horizon;
+    float tilt;
+    float zfar; // view distance in map units, up to VOXEL_MAX_DEPTH
+
+    int fogType; // 0 exponential, 1 linear
+    float fogDensity;
+    float fogStart;
+    float fogEnd;
+    Color fogColor;
+    Color linearFogColor; // fogType 1; translucent by default
+    Color sky;
+
+    bool lod;
+    int lodStart;
+    bool skipEmpty;
+    bool columnMajor;
+    bool palettized; // voxel_march_palette() when the terrain has indices
+} VoxelRenderConfig;
+
+// Renders a terrain into a caller-owned RENDER_WIDTH x RENDER_HEIGHT RGBA
+// buffer from an explicit camera. Makes no GL calls, so it runs without a
+// window.
+typedef struct
+{
+    const Terrain *terrain; // not owned
+    Color *pixels;          // not owned
+
+    // Paged world rendered instead of the terrain when set, not owned. Its
+    // table may only change between voxel_renderer_render() calls.
+    const VoxelPageTable *pages;
+    VoxelRenderConfig config;
+
+    WorkerPool pool;
+    bool poolReady;
+    VoxelKernel kernel;
+    VoxelKernelFn kernelFn;
+
+    Color *columnBuffer; // allocated on the first column-major frame
+
+    float fogTable[VOXEL_MAX_DEPTH];
+    VoxelFogEntry fogBlendTable[VOXEL_MAX_DEPTH];
+    int32_t invZTable[VOXEL_MAX_DEPTH];
+    VoxelRenderConfig fogTableConfig; // fog settings the tables were built for
+    bool fogTableReady;
+
+    // VOXEL_FOG_WEIGHTS fogged copies of the terrain palette, allocated on
+    // the first palettized frame and rebuilt when the fog or palette changes
+    Color *fogPalettes;
+    Color fogPaletteSource[TERRAIN_PALETTE_SIZE];
+    bool fogPalettesReady;
+
+    VoxelFrame frame;
+    VoxelStats stats;
+    int columnWrites[RENDER_WIDTH];
+    long long lastRaySteps;
+    long long lastPixelsWritten; // by the kernels, before any transpose
+} VoxelRenderer;
+
+// Defaults matching the interactive renderer
+VoxelRenderConfig voxel_render_config_default(void);
+
+// Starts the worker threads (one per core) and picks the AUTO kernel
+bool voxel_renderer_init(VoxelRenderer *renderer, const Terrain *terrain, Color *pixels, VoxelRenderConfig config);
+
+void voxel_renderer_free(VoxelRenderer *renderer);
+
+// Threads the columns are split across, including the caller. 0 picks one
+// per core, 1 renders on the calling thread only.
+void voxel_renderer_set_threads(VoxelRenderer *renderer, int count);
+
+// Falls back to the best supported kernel when the CPU lacks the requested one
+void voxel_renderer_set_kernel(VoxelRenderer *renderer, VoxelKernel kernel);
+
+// Draws one frame seen from the camera's position towards its target
+void voxel_renderer_render(VoxelRenderer *renderer, Camera3D camera);
+
+// Total number of heap allocations made by renderers so far
+size_t voxel_renderer_allocation_count(void);
+
+#endif // VOXEL_RENDERER_H
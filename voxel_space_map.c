@@ -1,23 +1,70 @@
 #include "voxel_space_map.h"
 #include "camera.h"
+#include "terrain.h"
+#include "voxel_renderer.h"
+#include "map_loader.h"
+#include "tile_cache.h"
+#include "terrain_gen.h"
+#include "heap_stats.h"
 #include "raylib.h"
 #include <math.h>
 
-Color *colorMap = NULL;
-Color *heightMap = NULL;
+Terrain terrain = { 0 };
 Color *screenBuffer = NULL;
 Texture2D screenTexture = { 0 };
-Image colorMapImage = {0};
-Image heightMapImage = {0};
+
+// Heap allocations made while the last render_map() ran
+static size_t lastFrameAllocations = 0;
+
+// Draws the terrain into screenBuffer; render_map() only adds the upload
+static VoxelRenderer mapRenderer;
+static bool mapRendererReady = false;
+
+// Decodes the map change_map() asked for while the current one keeps
+// rendering; render_map() swaps it in before drawing
+static MapLoader mapLoader;
+static MapLoadStats lastMapLoad = { .map = -1 };
+
+// Paged worlds: every map stitched into a grid, or generated terrain,
+// streamed through a page cache
+#define WORLD_MAPS_SHIFT_X 3 // 8 x 4 maps, 8192 x 4096 texels
+#define WORLD_MAPS_SHIFT_Y 2
+#define WORLD_GEN_SHIFT 8 // 256 x 256 pages, 65536 x 65536 texels
+#define WORLD_GEN_SEED 1337
+#define WORLD_CACHE_BUDGET (64 * 1024 * 1024)
+#define WORLD_MAPS_BUDGET (40 * 1024 * 1024) // of the above, about 4 source maps
+#define WORLD_LOADER_THREADS 2
+#define WORLD_PREFETCH_FRAMES 90 // how far ahead of the camera to fetch
+
+static TileMapSource worldSource;
+static TerrainGenerator worldGenerator;
+static TileCache worldCache;
+static WorldMode worldMode = WORLD_SINGLE_MAP;
+static Vector2 lastWorldPosition; // camera position at the last frame or world switch
+
+// Requested before or after the renderer exists, applied to it by init_map()
+static int renderThreads = 0;
+static VoxelKernel renderKernel = VOXEL_KERNEL_AUTO;
 
 float voxel_horizon = 100.0f;
 float voxel_tilt = 0.0f;
 float voxel_zfar = 600.0f;
 
-// Pre-calculated tables for optimization
-static float fogTable[1024];
-static float invZTable[1024];
-static float currentFogDensity = -1.0f;
+// Distance-based LOD marching, which lets voxel_zfar go past MAP_N
+static bool voxel_lod = false;
+static int voxel_lod_start = 256;
+
+// Empty-space skipping through the terrain's max-height pyramid
+static bool voxel_skip_empty = false;
+
+// Render into a column buffer and transpose into screenBuffer per tile
+static bool voxel_column_major = false;
+
+// Palette indices and fogged palettes instead of RGB texels and per-span fog
+static bool voxel_palettized = false;
+
+static Color fogColor = { 180, 180, 180, 255 };
+static Color linearFogColor = { 180, 180, 180, 100 };
 
 map_t maps[NUM_MAPS];
 
@@ -77,8 +124,14 @@ void LoadMaps()
 
 void change_map(int map_index)
 {
-    selectedMap = map_index;
-    init_map();
+    if (map_index < 0 || map_index >= NUM_MAPS) return;
+
+    if (!mapLoader.running) {
+        // No loader thread, load in place
+        if (terrain_load_cached(&terrain, maps[map_index].colorMap, maps[map_index].heightMap)) selectedMap = map_index;
+        return;
+    }
+    map_loader_request(&mapLoader, map_index, maps[map_index].colorMap, maps[map_index].heightMap);
 }
 
 int get_current_map()
@@ -86,25 +139,48 @@ int get_current_map()
     return selectedMap;
 }
 
+bool is_map_loading(void)
+{
+    return map_loader_busy(&mapLoader);
+}
+
+double get_map_load_latency_ms(void)
+{
+    return lastMapLoad.latencyMs;
+}
+
+double get_map_load_decode_ms(void)
+{
+    return lastMapLoad.decodeMs;
+}
+
 void init_map()
 {
     LoadMaps();
 
-    colorMapImage = LoadImage(maps[selectedMap].colorMap);
-    heightMapImage = LoadImage(maps[selectedMap].heightMap);
+    // Decode both maps once; render_map() only reads the resident arrays.
+    // The first map loads here since there is nothing to show meanwhile,
+    // later ones on the loader thread.
+    terrain_load_cached(&terrain, maps[selectedMap].colorMap, maps[selectedMap].heightMap);
+    if (!mapLoader.running) map_loader_start(&mapLoader);
 
-    if (colorMapImage.data == NULL || heightMapImage.data == NULL) {
-        TraceLog(LOG_ERROR, "VOXEL: Failed to load map files. Check if 'resources' directory exists in working directory.");
-    } else {
-        colorMap = LoadImageColors(colorMapImage);
-        heightMap = LoadImageColors(heightMapImage);
-    }
+    // The buffer and texture do not depend on the map, so they are made once
+    if (screenBuffer) return;
 
     screenBuffer = (Color *)malloc(RENDER_WIDTH * RENDER_HEIGHT * sizeof(Color));
     if (screenBuffer) {
         for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++) screenBuffer[i] = BLACK;
     }
-    
+
+    if (!mapRendererReady) {
+        voxel_renderer_init(&mapRenderer, &terrain, screenBuffer, voxel_render_config_default());
+        if (renderThreads != 0) voxel_renderer_set_threads(&mapRenderer, renderThreads);
+        voxel_renderer_set_kernel(&mapRenderer, renderKernel);
+        mapRendererReady = true;
+    }
+    mapRenderer.pixels = screenBuffer;
+    mapRenderer.pages = worldMode != WORLD_SINGLE_MAP ? &worldCache.pages : NULL;
+
     // Create an image that references the screenBuffer
     // We will use this to initialize the texture
     Image screenImage = {
@@ -118,167 +194,198 @@ void init_map()
     screenTexture = LoadTextureFromImage(screenImage);
 }
 
-void render_map() 
+void set_render_threads(int count)
 {
-    // Sync with engine camera
-    Camera3D *engineCamera = get_camera();
-
-    float camX = engineCamera->position.x;
-    float camY = engineCamera->position.z; 
-    float camHeight = engineCamera->position.y;
-    float camAngle = atan2f(engineCamera->target.z - engineCamera->position.z, engineCamera->target.x - engineCamera->position.x);
-
-    // Calculate fractional movement to fix Z-judder
-    // We assume the forward direction is roughly aligned with the camera target
-    float dirX = engineCamera->target.x - engineCamera->position.x;
-    float dirZ = engineCamera->target.z - engineCamera->position.z;
-    float dirLen = sqrtf(dirX*dirX + dirZ*dirZ);
-    if (dirLen > 0) {
-        dirX /= dirLen;
-        dirZ /= dirLen;
+    renderThreads = count;
+    if (mapRendererReady) voxel_renderer_set_threads(&mapRenderer, count);
+}
+
+int get_render_threads(void)
+{
+    return mapRendererReady && mapRenderer.poolReady ? mapRenderer.pool.threadCount : 0;
+}
+
+void set_render_kernel(VoxelKernel kernel)
+{
+    renderKernel = kernel;
+    if (mapRendererReady) voxel_renderer_set_kernel(&mapRenderer, kernel);
+}
+
+VoxelKernel get_render_kernel(void)
+{
+    return mapRendererReady ? mapRenderer.kernel : voxel_kernel_resolve(renderKernel);
+}
+
+void set_render_lod(bool enabled, int startDistance)
+{
+    voxel_lod = enabled;
+    voxel_lod_start = startDistance > 1 ? startDistance : 1;
+}
+
+void set_render_skip_empty(bool enabled)
+{
+    voxel_skip_empty = enabled;
+}
+
+void set_render_column_major(bool enabled)
+{
+    voxel_column_major = enabled;
+}
+
+void set_render_palettized(bool enabled)
+{
+    voxel_palettized = enabled;
+}
+
+void set_render_fog_color(Color color)
+{
+    fogColor = color;
+}
+
+void set_render_linear_fog_color(Color color)
+{
+    linearFogColor = color;
+}
+
+static void free_world(void)
+{
+    if (worldMode != WORLD_SINGLE_MAP) {
+        mapRenderer.pages = NULL;
+        tile_cache_free(&worldCache);
+        if (worldMode == WORLD_TILED_MAPS) tile_map_source_free(&worldSource);
     }
+    worldMode = WORLD_SINGLE_MAP;
+}
+
+bool set_render_world(WorldMode mode)
+{
+    if (mode == worldMode) return true;
+    free_world();
+    if (mode == WORLD_SINGLE_MAP) return true;
 
-    // depthOffset is how much we have moved "into" the current map grid unit
-    // along the look direction.
-    float depthOffset = (camX * dirX + camY * dirZ);
-    depthOffset -= floorf(depthOffset);
-
-   
-    if (colorMap) UnloadImageColors(colorMap);
-    if (heightMap) UnloadImageColors(heightMap);
-    
-    colorMap = LoadImageColors(colorMapImage);
-    heightMap = LoadImageColors(heightMapImage);
-    
-    // Pre-calculate tables if needed
-    if (currentFogDensity != fogDensity) {
-        for (int z = 0; z < 1024; z++) {
-            fogTable[z] = 1.0f / expf(z * fogDensity);
-            invZTable[z] = 1.0f / (float)(z > 0 ? z : 1);
-        }
-        currentFogDensity = fogDensity;
+    TileSource tiles;
+    if (mode == WORLD_TILED_MAPS) {
+        if (!tile_map_source_init(&worldSource, maps, NUM_MAPS, WORLD_MAPS_SHIFT_X, WORLD_MAPS_SHIFT_Y, WORLD_MAPS_BUDGET, &tiles)) return false;
+    } else {
+        terrain_gen_init(&worldGenerator, WORLD_GEN_SEED, WORLD_GEN_SHIFT, WORLD_GEN_SHIFT, renderKernel);
+        tiles = terrain_gen_source(&worldGenerator);
+    }
+    if (!tile_cache_init(&worldCache, tiles, WORLD_CACHE_BUDGET, WORLD_LOADER_THREADS)) {
+        if (mode == WORLD_TILED_MAPS) tile_map_source_free(&worldSource);
+        return false;
     }
 
-    // Clear backbuffer
-    for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++) {
-        screenBuffer[i] = (Color){ 0, 0, 0, 0 }; // Transparent clear
+    worldMode = mode;
+    mapRenderer.pages = &worldCache.pages;
+
+    // The camera has not moved in the new world yet
+    Camera3D *camera = get_camera();
+    lastWorldPosition = (Vector2){ camera->position.x, camera->position.z };
+    return true;
+}
+
+WorldMode get_render_world(void)
+{
+    return worldMode;
+}
+
+int get_map_resident_tiles(void)
+{
+    return worldMode != WORLD_SINGLE_MAP ? tile_cache_stats(&worldCache).residentPages : 0;
+}
+
+int get_map_missing_tiles(void)
+{
+    return worldMode != WORLD_SINGLE_MAP ? tile_cache_stats(&worldCache).missingPages : 0;
+}
+
+double get_map_tiles_per_second(void)
+{
+    return worldMode != WORLD_SINGLE_MAP ? tile_cache_stats(&worldCache).pagesPerSecond : 0.0;
+}
+
+void set_render_zfar(float zfar)
+{
+    if (zfar < 2.0f) zfar = 2.0f;
+    if (zfar > VOXEL_MAX_DEPTH) zfar = VOXEL_MAX_DEPTH;
+    voxel_zfar = zfar;
+}
+
+size_t get_map_frame_allocations(void)
+{
+    return lastFrameAllocations;
+}
+
+long long get_map_frame_ray_steps(void)
+{
+    return mapRendererReady ? mapRenderer.lastRaySteps : 0;
+}
+
+void render_map() 
+{
+    if (!mapRendererReady) return;
+
+    // Before anything else, so the count covers the whole frame
+    size_t allocationsAtStart = heap_allocation_count();
+
+    // Frame boundary: the workers are idle, so the terrain can be replaced
+    if (map_loader_poll(&mapLoader, &terrain, &lastMapLoad)) {
+        selectedMap = lastMapLoad.map;
+        TraceLog(LOG_INFO, "MAP: Switched to map %d, decoded in %.1f ms, %.1f ms after the request",
+                 lastMapLoad.map, lastMapLoad.decodeMs, lastMapLoad.latencyMs);
     }
 
-    float sinangle = sin(camAngle);
-    float cosangle = cos(camAngle);
-
-    float plx = cosangle * voxel_zfar + sinangle * voxel_zfar;
-    float ply = sinangle * voxel_zfar - cosangle * voxel_zfar;
-
-    float prx = cosangle * voxel_zfar - sinangle * voxel_zfar;
-    float pry = sinangle * voxel_zfar + cosangle * voxel_zfar;
-
-    float inv_zfar = 1.0f / voxel_zfar;
-    float inv_render_width = 1.0f / (float)RENDER_WIDTH;
-    int zfar_int = (int)voxel_zfar;
-    if (zfar_int > 1024) zfar_int = 1024;
-
-    // Use fractional Y (depth) to offset the starting sampling position
-    // We offset the start to align exactly with the camera world position
-    float startRX = camX;
-    float startRY = camY;
-
-    // Adjust start position by one half step to center sampling on the first slice
-    // This further stabilizes the forward movement
-    float initialStep = 1.0f - depthOffset;
-    
-    for (int i = 0; i < RENDER_WIDTH; i++) {
-        float deltaX = (plx + (prx - plx) * i * inv_render_width) * inv_zfar;
-        float deltaY = (ply + (pry - ply) * i * inv_render_width) * inv_zfar;
-
-        float rx = startRX + deltaX * initialStep;
-        float ry = startRY + deltaY * initialStep;
-
-        float maxHeight = (float)RENDER_HEIGHT;
-        float lean = (voxel_tilt * (i * inv_render_width - 0.5f) + 0.5f) * RENDER_HEIGHT / 6.0f;
-
-        for (int z = 1; z < zfar_int; z++) {
-            rx += deltaX;
-            ry += deltaY;
-
-            if (heightMap && colorMap) {
-                // Bilinear interpolation for smooth height sampling
-                float floorX = floorf(rx);
-                float floorY = floorf(ry);
-                float fx = rx - floorX;
-                float fy = ry - floorY;
-                
-                int x0 = ((int)floorX) & (MAP_N - 1);
-                int y0 = ((int)floorY) & (MAP_N - 1);
-                int x1 = (x0 + 1) & (MAP_N - 1);
-                int y1 = (y0 + 1) & (MAP_N - 1);
-
-                float h00 = heightMap[y0 * MAP_N + x0].r;
-                float h10 = heightMap[y0 * MAP_N + x1].r;
-                float h01 = heightMap[y1 * MAP_N + x0].r;
-                float h11 = heightMap[y1 * MAP_N + x1].r;
-
-                // Bilinear blend
-                float h = h00 * (1.0f - fx) * (1.0f - fy) + 
-                          h10 * fx * (1.0f - fy) + 
-                          h01 * (1.0f - fx) * fy + 
-                          h11 * fx * fy;
-                
-                // Use a continuous distance for projection to eliminate Z-judder
-                // We subtract the fractional progress into the current grid cell
-                float continuousZ = (float)z - depthOffset;
-                if (continuousZ < 0.1f) continuousZ = 0.1f;
-                
-                int projHeight = (int)((camHeight - h) / continuousZ * SCALE_FACTOR + voxel_horizon);
-                if (projHeight < 0) projHeight = 0;
-                if (projHeight >= RENDER_HEIGHT) projHeight = RENDER_HEIGHT - 1;
-
-                if (projHeight < maxHeight) {
-                    float fogFactor = fogTable[z];
-                    // Still sample color from nearest to keep it fast
-                    int mapoffset = (MAP_N * y0) + x0;
-                    Color pixel = colorMap[mapoffset];
-                    Color scaledPixel = GetScaledPixel(pixel, (Color){180, 180, 180, 255}, fogFactor);
-
-                    if (fogType == 1) {
-                        float fStart = fogStart;
-                        float fEnd = fogEnd;
-                        if (fEnd <= fStart) fEnd = fStart + 1.0f;
-                        scaledPixel = GetScaledPixel(pixel, (Color){180, 180, 180, 100}, GetLinearFogFactor((int)fEnd, (int)fStart, z));
-                    }
-
-                    int startY = (int)(projHeight + lean);
-                    int endY = (int)(maxHeight + lean);
-                    
-                    if (startY < 0) startY = 0;
-                    if (endY > RENDER_HEIGHT) endY = RENDER_HEIGHT;
-
-                    if (screenBuffer) {
-                        for (int y = startY; y < endY; y++) {
-                            screenBuffer[y * RENDER_WIDTH + i] = scaledPixel;
-                        }
-                    }
-                    maxHeight = (float)projHeight;
-                }
-            }
-        }
+    VoxelRenderConfig *config = &mapRenderer.config;
+    config->horizon = voxel_horizon;
+    config->tilt = voxel_tilt;
+    config->zfar = voxel_zfar;
+    config->fogType = fogType;
+    config->fogDensity = fogDensity;
+    config->fogStart = fogStart;
+    config->fogEnd = fogEnd;
+    config->fogColor = fogColor;
+    config->linearFogColor = linearFogColor;
+    config->lod = voxel_lod;
+    config->lodStart = voxel_lod_start;
+    config->skipEmpty = voxel_skip_empty;
+    config->columnMajor = voxel_column_major;
+    config->palettized = voxel_palettized;
+
+    // Stream the world's pages around the camera and along its direction of travel
+    Camera3D *camera = get_camera();
+    if (worldMode != WORLD_SINGLE_MAP) {
+        Vector2 position = { camera->position.x, camera->position.z };
+        Vector2 ahead = {
+            position.x + (position.x - lastWorldPosition.x) * WORLD_PREFETCH_FRAMES,
+            position.y + (position.y - lastWorldPosition.y) * WORLD_PREFETCH_FRAMES,
+        };
+        tile_cache_update(&worldCache, position, ahead, voxel_zfar);
+        lastWorldPosition = position;
     }
 
+    // Sync with engine camera
+    voxel_renderer_render(&mapRenderer, *camera);
+
     // Update texture and draw upscaled
     UpdateTexture(screenTexture, screenBuffer);
     DrawTexturePro(screenTexture, 
         (Rectangle){ 0, 0, RENDER_WIDTH, RENDER_HEIGHT },
         (Rectangle){ 0, 0, GetScreenWidth(), GetScreenHeight() },
         (Vector2){ 0, 0 }, 0.0f, WHITE);
+
+    lastFrameAllocations = heap_allocation_count() - allocationsAtStart;
 }
 
 void cleanup_map()
 {
-    if (colorMap) UnloadImageColors(colorMap);
-    if (heightMap) UnloadImageColors(heightMap);
+    map_loader_stop(&mapLoader);
+    free_world();
+    terrain_unload(&terrain);
     if (screenBuffer) free(screenBuffer);
-    UnloadImage(colorMapImage);
-    UnloadImage(heightMapImage);
+    screenBuffer = NULL;
+    if (mapRendererReady) voxel_renderer_free(&mapRenderer);
+    mapRendererReady = false;
     UnloadTexture(screenTexture);
+    screenTexture = (Texture2D){ 0 };
 }
 
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include "voxel_kernels.h"
 
 #define FPS 60
 #define MAP_N 1024
@@ -19,6 +20,9 @@ typedef struct {
     char heightMap[50];
 } map_t;
 
+// Color and height map paths of every map, filled by LoadMaps()
+extern map_t maps[NUM_MAPS];
+
 int GetLinearFogFactor(int fogEnd, int fogStart, int z);
 
 float GetExponentialFogFactor(float fogDensity, int z);
@@ -37,6 +41,90 @@ void cleanup_map();
 
 int get_current_map();
 
+// Starts decoding the map on the loader thread and returns right away. The
+// current map keeps rendering until render_map() swaps the new one in, at
+// which point get_current_map() reports it. Only the last request counts.
 void change_map(int map_index);
 
+// True while a requested map has not been swapped in yet
+bool is_map_loading(void);
+
+// Time from the last completed change_map() request until its first frame
+double get_map_load_latency_ms(void);
+
+// Part of that spent decoding on the loader thread
+double get_map_load_decode_ms(void);
+
+// Number of threads render_map() splits the columns across, including the
+// caller. 0 picks one per core, 1 renders on the calling thread only.
+void set_render_threads(int count);
+
+int get_render_threads(void);
+
+// Column marching kernel; AUTO picks the widest SIMD kernel the CPU supports
+void set_render_kernel(VoxelKernel kernel);
+
+VoxelKernel get_render_kernel(void);
+
+// Distance-based LOD marching: full-resolution unit steps up to startDistance,
+// then the step doubles (and sampling drops one mip level) each time the
+// distance doubles. Without LOD the view distance is capped at MAP_N.
+void set_render_lod(bool enabled, int startDistance);
+
+// Skip ray steps over terrain blocks that cannot rise above the horizon
+// drawn so far, using the max-height pyramid. Output is unchanged.
+void set_render_skip_empty(bool enabled);
+
+// Render each column into a contiguous buffer and transpose it to rows
+// before upload, instead of writing rows directly. Output is unchanged.
+void set_render_column_major(bool enabled);
+
+// Sample 8-bit palette indices instead of RGB texels and shade from
+// palettes fogged once per fog level, instead of blending every span.
+// Output is unchanged. LOD and empty-space skipping take precedence.
+void set_render_palettized(bool enabled);
+
+// Color distant terrain fades to with exponential fog, opaque light grey by default
+void set_render_fog_color(Color color);
+
+// Same for linear fog, light grey at alpha 100 by default
+void set_render_linear_fog_color(Color color);
+
+// View distance in map units, up to VOXEL_MAX_DEPTH
+void set_render_zfar(float zfar);
+
+typedef enum
+{
+    WORLD_SINGLE_MAP,  // the current map, wrapping
+    WORLD_TILED_MAPS,  // every map stitched into an 8 x 4 grid
+    WORLD_GENERATED,   // procedural terrain, 65536 x 65536 texels, wrapping
+} WorldMode;
+
+// What render_map() draws. The paged worlds stream 256 x 256 pages through
+// a 64 MB cache as the camera moves, loaded or generated on two background
+// threads; pages that are not ready yet show as flat ground. LOD and
+// empty-space skipping do not apply to them.
+bool set_render_world(WorldMode mode);
+
+WorldMode get_render_world(void);
+
+// Pages of the paged world in memory, and ones the last frame wanted but
+// drew as placeholders
+int get_map_resident_tiles(void);
+
+int get_map_missing_tiles(void);
+
+// Pages the loader threads fill per second while busy
+double get_map_tiles_per_second(void);
+
+
+// malloc(), calloc() and realloc() calls made by any thread while the last
+// render_map() ran, raylib's upload included; 0 in steady state. Pages and
+// maps loading in the background add to it. Needs a HEAP_COUNTING build,
+// see heap_stats.h, and stays 0 without.
+size_t get_map_frame_allocations(void);
+
+// Height samples taken over all columns during the last render_map()
+long long get_map_frame_ray_steps(void);
+
 #endif
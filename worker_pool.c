@@ -0,0 +1,129 @@
+#include "worker_pool.h"
+#include <raylib.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void run_tiles(WorkerPool *pool)
+{
+    for (;;) {
+        int begin = atomic_fetch_add(&pool->nextItem, pool->tileSize);
+        if (begin >= pool->itemCount) break;
+
+        int end = begin + pool->tileSize;
+        if (end > pool->itemCount) end = pool->itemCount;
+        pool->task(pool->userData, begin, end);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    WorkerPool *pool = (WorkerPool *)arg;
+    unsigned int seenGeneration = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->quit && pool->generation == seenGeneration) {
+            pthread_cond_wait(&pool->workReady, &pool->mutex);
+        }
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        seenGeneration = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_tiles(pool);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pendingWorkers == 0) pthread_cond_signal(&pool->workDone);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+int worker_pool_core_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+bool worker_pool_init(WorkerPool *pool, int threadCount)
+{
+    *pool = (WorkerPool){ 0 };
+    if (threadCount <= 0) threadCount = worker_pool_core_count();
+
+    // Allocate before initialising the sync objects, so a failure leaves
+    // nothing to destroy and the caller can retry with fewer threads
+    if (threadCount > 1) {
+        pool->threads = (pthread_t *)malloc((threadCount - 1) * sizeof(pthread_t));
+        if (pool->threads == NULL) return false;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->workDone, NULL);
+    atomic_init(&pool->nextItem, 0);
+    pool->threadCount = 1;
+
+    if (threadCount == 1) return true;
+
+    // The calling thread is the first worker, so only spawn the rest
+    for (int i = 0; i < threadCount - 1; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            TraceLog(LOG_WARNING, "WORKERS: Could only start %d of %d threads", pool->threadCount, threadCount);
+            break;
+        }
+        pool->threadCount++;
+    }
+
+    return true;
+}
+
+void worker_pool_run(WorkerPool *pool, int itemCount, int tileSize, WorkerTask task, void *userData)
+{
+    if (itemCount <= 0) return;
+    if (tileSize <= 0) tileSize = 1;
+
+    if (pool->threadCount <= 1) {
+        task(userData, 0, itemCount);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->userData = userData;
+    pool->itemCount = itemCount;
+    pool->tileSize = tileSize;
+    atomic_store(&pool->nextItem, 0);
+    pool->pendingWorkers = pool->threadCount - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_tiles(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pendingWorkers > 0) {
+        pthread_cond_wait(&pool->workDone, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void worker_pool_shutdown(WorkerPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->threadCount - 1; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_cond_destroy(&pool->workDone);
+    *pool = (WorkerPool){ 0 };
+}
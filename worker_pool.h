@@ -0,0 +1,42 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Processes items [begin, end) of a job
+typedef void (*WorkerTask)(void *userData, int begin, int end);
+
+// Persistent pool of worker threads. A job is split into tiles of
+// consecutive items which the workers and the calling thread claim until
+// none are left; worker_pool_run() returns once every tile is done.
+typedef struct
+{
+    pthread_t *threads;
+    int threadCount; // total, including the calling thread
+
+    pthread_mutex_t mutex;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    unsigned int generation;
+    int pendingWorkers;
+    bool quit;
+
+    WorkerTask task;
+    void *userData;
+    int itemCount;
+    int tileSize;
+    atomic_int nextItem;
+} WorkerPool;
+
+// threadCount <= 0 uses one thread per core. A pool of one thread runs every job inline.
+bool worker_pool_init(WorkerPool *pool, int threadCount);
+
+void worker_pool_run(WorkerPool *pool, int itemCount, int tileSize, WorkerTask task, void *userData);
+
+void worker_pool_shutdown(WorkerPool *pool);
+
+int worker_pool_core_count(void);
+
+#endif // WORKER_POOL_H